@@ -139,6 +139,17 @@ namespace PeterDB {
                     code = error("I expect <tableName>, <indexName>, <attribute>");
             }
 
+                ////////////////////////////////////////////
+                // compact index <columnName> on <tableName>
+                ////////////////////////////////////////////
+            else if (expect(tokenizer, "compact")) {
+                tokenizer = next();
+                if (expect(tokenizer, "index")) {
+                    code = compactIndex();
+                } else
+                    code = error("I expect <index>");
+            }
+
                 ////////////////////////////////////////////
                 // load <tableName> <fileName>
                 // drop index <indexName>
@@ -1098,6 +1109,31 @@ namespace PeterDB {
         return rc;
     }
 
+    // compact index <columnName> on <tableName>
+    RC CLI::compactIndex() {
+        char *tokenizer = next();
+        std::string columnName = std::string(tokenizer);
+
+        tokenizer = next();
+        if (!expect(tokenizer, "on")) {
+            return error("syntax error: expecting \"on\"");
+        }
+
+        tokenizer = next();
+        std::string tableName = std::string(tokenizer);
+
+        // check if index is there or not
+        RID rid;
+        if (!this->checkAttribute(tableName, columnName, rid, false)) {
+            return error("given " + tableName + ":" + columnName + " index does not exist in cli_indexes");
+        }
+
+        if (rm.compactIndex(tableName, columnName) != 0)
+            return error("error while compacting index in ixManager");
+
+        return 0;
+    }
+
     // drop the system catalog
     RC CLI::dropCatalog() {
         if (rm.deleteCatalog() != 0) {
@@ -1496,6 +1532,9 @@ namespace PeterDB {
             std::cout << "\tdrop index <attributeName> on <tableName>: drops given index" << std::endl;
             std::cout << "\tdrop attribute <attributeName> from <tableName>: drops attributeName from tableName" << std::endl;
             std::cout << "\tdrop catalog" << std::endl;
+        } else if (input == "compact") {
+            std::cout << "\tcompact index <attributeName> on <tableName>: rebuilds given index and shrinks its file"
+                 << std::endl;
         } else if (input == "insert") {
             std::cout << "\tinsert into <tableName> tuple(attr1 = val1, attr2 = value2, ...)";
             std::cout << ": inserts given tuple to given tableName" << std::endl;
@@ -1535,6 +1574,7 @@ namespace PeterDB {
         } else if (input == "all") {
             help("create");
             help("drop");
+            help("compact");
             help("print");
             help("insert");
             help("load");
@@ -60,6 +60,8 @@ namespace PeterDB {
 
         RC dropCatalog();
 
+        RC compactIndex();
+
         RC addAttribute();
 
         RC insertTuple();
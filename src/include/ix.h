@@ -4,6 +4,8 @@
 #include <vector>
 #include <string>
 #include <climits>
+#include <cstdio>
+#include <unordered_map>
 
 #include "rbfm.h"
 
@@ -13,10 +15,21 @@ namespace PeterDB {
 
 #define UNDEFINED_PAGE_NUM UINT_MAX
 
+#define NODE_CACHE_SIZE 64  // inner node pages an IXFileHandle keeps in memory
+
+#define BULK_LOAD_BUFFER_SIZE (256 * PAGE_SIZE)  // entry bytes sorted in memory before a run is spilled
+#define BULK_LOAD_MERGE_FAN_IN 64               // runs open at once while merging
+
     typedef unsigned short PageIndex;
 
     const PageIndex RID_SIZE = sizeof(PageNum) + sizeof(SlotNum);
 
+    // An inner node page kept in memory
+    typedef struct CachedNode {
+        std::vector<char> page;
+        std::vector<PageIndex> keyOffsets;  // offsets of the VarChar keys and of the end of the last, empty for fixed-length keys
+    } CachedNode;
+
     typedef struct Entry {
         bool isNull = true;
         PageNum nodeNum;
@@ -50,8 +63,8 @@ namespace PeterDB {
         // Delete an index file.
         RC destroyFile(const std::string &fileName);
 
-        // Open an index and return an ixFileHandle.
-        RC openFile(const std::string &fileName, IXFileHandle &ixFileHandle);
+        // Open an index and return an ixFileHandle, memory-mapped for read-only scans if mapped is set.
+        RC openFile(const std::string &fileName, IXFileHandle &ixFileHandle, bool mapped = false);
 
         // Close an ixFileHandle for an index.
         RC closeFile(IXFileHandle &ixFileHandle);
@@ -59,9 +72,19 @@ namespace PeterDB {
         // Write the page num of root to disk.
         RC writeRootPageNum(IXFileHandle &ixFileHandle);
 
-        // Read the page num of root from disk.
+        // Read the page num of root from disk, dropping the cached nodes if the tree changed through another handle.
         RC readRootPageNum(IXFileHandle &ixFileHandle);
 
+        // Read a page, taking inner nodes from the node cache of the handle. keyOffsets, if given, is pointed at the
+        // cached offsets of the node's VarChar keys, or set to nullptr if there are none.
+        RC readNode(IXFileHandle &ixFileHandle, PageNum pageNum, char *pageBuffer, const PageIndex **keyOffsets = nullptr);
+
+        // Keep a copy of an inner node page with the offsets of its VarChar keys.
+        void cacheNode(IXFileHandle &ixFileHandle, CachedNode &cachedNode, const char *pageBuffer);
+
+        // Write a page of the tree, appending it if it is the page after the last one.
+        RC writeNewPage(IXFileHandle &ixFileHandle, PageNum pageNum, const void *data);
+
 
         // General Index Functions
 
@@ -89,6 +112,16 @@ namespace PeterDB {
         // Compare composite key in page buffer with the one given.
         int compareCompKey(const char *pageBuffer, const void *key, const RID &rid, unsigned keyType);
 
+        // Get the offsets of the keyListSize composite keys starting at firstKeyOffset, followed by the end of the last.
+        // Only VarChar keys need them gathered, fixed-length keys sit at a constant stride.
+        void getKeyOffsets(const char *pageBuffer, PageIndex firstKeyOffset, PageIndex keyListSize, unsigned keyType, PageIndex *keyOffsets);
+
+        // Get the offset of the index-th composite key, from keyOffsets for VarChar keys and by stride otherwise.
+        PageIndex getKeyOffset(PageIndex firstKeyOffset, const PageIndex *keyOffsets, PageIndex index, unsigned keyType);
+
+        // Get the offset of the index-th composite key, walking over the keys before it if they are VarChar.
+        PageIndex getKeyOffset(const char *pageBuffer, PageIndex firstKeyOffset, PageIndex index, unsigned keyType);
+
 
         // Node Functions
 
@@ -101,8 +134,9 @@ namespace PeterDB {
         // Whether a node page has space for an entry.
         bool hasNodeSpace(const char *nodeBuffer, int keyLength);
 
-        // Find the page num pointer by the given key.
-        PageNum findInNode(const char *nodeBuffer, const void *key, unsigned keyType, int &pageNumOffset, int &keyOffset, const RID &rid);
+        // Find the page num pointer by the given key, using keyOffsets for VarChar keys if given.
+        PageNum findInNode(const char *nodeBuffer, const void *key, unsigned keyType, int &pageNumOffset, int &keyOffset, const RID &rid,
+                           const PageIndex *keyOffsets = nullptr);
 
         // Insert a key-RID pair in a node page, free space guaranteed.
         void insertNode(char *nodeBuffer, int pageNumOffset, int keyOffset, const Entry &entry);
@@ -117,7 +151,7 @@ namespace PeterDB {
         RC createLeaf(char *leafBuffer);
 
         // Whether a page is leaf.
-        bool isLeaf(char *pageBuffer);
+        bool isLeaf(const char *pageBuffer);
 
         // Get next page num in a leaf page.
         PageNum getNextPageNum(const char *leafBuffer);
@@ -150,6 +184,11 @@ namespace PeterDB {
         // Delete an entry from the given index that is indicated by the given ixFileHandle.
         RC deleteEntry(IXFileHandle &ixFileHandle, const Attribute &attribute, const void *key, const RID &rid);
 
+        // Rebuild an index with its leaves filled up to fillFactor and cut the pages no longer used off the file.
+        // deleteEntry never merges or redistributes nodes, so this is the only way an index shrinks after deletes.
+        // Scans open on the index have to be started again afterwards.
+        RC compactIndex(IXFileHandle &ixFileHandle, const Attribute &attribute, float fillFactor = 1.0f);
+
         // Initialize and IX_ScanIterator to support a range search
         RC scan(IXFileHandle &ixFileHandle,
                 const Attribute &attribute,
@@ -196,9 +235,9 @@ namespace PeterDB {
         char *highKey = nullptr;
         bool highKeyInclusive;
 
-        int lastKeyLength;
-        char *lastKey = nullptr;
-        RID lastRid;
+        char *leafBuffer = nullptr;     // copy of the current leaf
+        unsigned leafVersion;           // write version of the index file when the leaf was copied
+        PageIndex lastOffset;           // offset of the entry before the next one, if index is not 0
 
         // Constructor
         IX_ScanIterator();
@@ -209,6 +248,25 @@ namespace PeterDB {
         // Get next matching entry
         RC getNextEntry(RID &rid, void *key);
 
+        // Get up to maxCount next matching entries, IX_EOF if there is none. Unless keys is nullptr, it gets the
+        // keys one after another in the insertEntry format and must have room for maxCount of them
+        RC getNextEntries(std::vector<RID> &rids, void *keys, unsigned maxCount);
+
+        // Get the entry at the position and move past it, without checking the copied leaf is current
+        RC nextEntry(RID &rid, void *key);
+
+        // Copy a leaf into leafBuffer and start at its first entry
+        RC loadLeaf(PageNum pageNum);
+
+        // Copy the current leaf again if the index was written since, keeping the position after the last entry
+        RC refreshLeaf();
+
+        // Move to the entry at index of leafBuffer
+        void setPosition(PageIndex position);
+
+        // Restart the scan at a new key range, keeping the file open
+        RC seek(const void *lowKey, const void *highKey, bool lowKeyInclusive, bool highKeyInclusive);
+
         // Init index scan
         RC init();
 
@@ -216,6 +274,89 @@ namespace PeterDB {
         RC close();
     };
 
+    // IX_BulkLoader builds an index from entries given in any order. Entries are sorted in runs of
+    // BULK_LOAD_BUFFER_SIZE bytes, spilled to temporary record files when they do not fit, and merged in passes of
+    // at most BULK_LOAD_MERGE_FAN_IN runs. An empty index is then packed left to right into leaves filled up to
+    // fillFactor, with the inner levels built bottom-up; an index that already has entries gets the sorted entries
+    // inserted one by one.
+    class IX_BulkLoader {
+    public:
+        IndexManager &ix = IndexManager::instance();
+        RecordBasedFileManager &rbfm = RecordBasedFileManager::instance();
+
+        // Constructor
+        IX_BulkLoader(IXFileHandle &ixFileHandle, const Attribute &attribute, float fillFactor = 1.0f);
+
+        // Destructor
+        ~IX_BulkLoader();
+
+        // Add an entry, "key" follows the same format as in IndexManager::insertEntry()
+        RC addEntry(const void *key, const RID &rid);
+
+        // Write every added entry into the index
+        RC finish();
+
+        // Replace the whole index with the added entries, which must be every entry it holds
+        RC rebuild();
+
+    private:
+        IXFileHandle &ixFileHandle;
+        Attribute attribute;
+        float fillFactor;
+        bool packing = false;                                   // whether the index is built from scratch
+
+        std::vector<char> entryBuffer;                          // composite keys of the current run, as stored in leaves
+        std::vector<unsigned> entryOffsets;
+        std::vector<std::string> runFileNames;                  // sorted runs spilled to temporary record files
+        std::vector<RBFM_ScanIterator *> runScans;              // one scan per run while the runs are merged
+        std::vector<std::vector<char>> heads;                   // next composite key of each run being merged
+        std::vector<unsigned> mergeHeap;                        // runs being merged that have entries left, smallest head first
+        std::vector<Attribute> runDescriptor;                   // key, page num and slot num of a spilled entry
+
+        char *leafBuffer = nullptr;
+        PageNum nextPageNum;                                    // page num of the next page written when packing
+        std::vector<std::pair<PageNum, std::vector<char>>> children;   // pages of the level being built with their first composite keys
+
+        // Compare two composite keys.
+        int compareEntries(const char *entry, const char *other);
+
+        // Sort the entries of the current run.
+        void sortRun();
+
+        // Write the current run to a temporary record file.
+        RC spillRun();
+
+        // Append a composite key to a run.
+        RC writeRun(FileHandle &fileHandle, const char *entry);
+
+        // Read the next composite key of a run, false at its end.
+        bool readRun(unsigned run, std::vector<char> &entry);
+
+        // Start merging count runs from the first one on.
+        RC openMerge(unsigned first, unsigned count);
+
+        // Get the smallest composite key left in the runs being merged, false once they are all read.
+        bool nextMerged(std::vector<char> &entry);
+
+        // Close the runs being merged.
+        void closeMerge();
+
+        // Sort the added entries and load them in order.
+        RC loadEntries();
+
+        // Add the next composite key in order to the index.
+        RC load(const char *entry);
+
+        // Write the next page when packing.
+        RC writePage(const void *data);
+
+        // Append the leaf being filled.
+        RC writeLeaf(bool last);
+
+        // Build the inner levels above the leaves and set the root of the index.
+        RC writeNodes();
+    };
+
     class IXFileHandle {
     public:
         FileHandle fileHandle;
@@ -223,6 +364,15 @@ namespace PeterDB {
         //index variables
         unsigned rootPageNum = UNDEFINED_PAGE_NUM;
         unsigned keyType; // 0: INTEGER, 1: FLOAT, 2: VARCHAR
+        unsigned treeVersion = 0; // bumped on disk whenever inner nodes change
+
+        // inner node pages kept in memory, valid while the root and tree version on disk match
+        std::unordered_map<PageNum, CachedNode> cachedNodes;
+
+        // the pointer page is not read again while every page write to the file since it was read went through this handle
+        bool pointerRead = false;       // whether the root and tree version were read from the pointer page
+        unsigned pointerVersion = 0;    // write version of the file when the pointer page was last read or written
+        unsigned pointerWrites = 0;     // page writes made through this handle by then
 
         // variables to keep counter for each operation
         unsigned ixReadPageCounter;
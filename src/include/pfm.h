@@ -3,9 +3,16 @@
 
 #define PAGE_SIZE 4096
 #define RECORD_SIZE 4096
+#define BUFFER_POOL_SIZE 256
+#define FREE_SPACE_SPAN (PAGE_SIZE / 2)     // data pages tracked by one free-space page
+#define FREE_SPACE_UNIT 16                  // bytes of free space per bucket step
+#define TEMP_FILE_PREFIX "peterdb_tmp_"     // reserved for the names of temporary files, no table may start with it
 
 #include <string>
 #include <cstring>
+#include <vector>
+#include <list>
+#include <unordered_map>
 
 #include "rc.h"
 
@@ -17,16 +24,86 @@ namespace PeterDB {
 
     class FileHandle;
 
+    // A page-sized slot of the buffer pool
+    typedef struct Frame {
+        unsigned fileId = 0;                // id of the file the cached page belongs to
+        PageNum pageNum = 0;                // page num of the cached page
+        char *data = nullptr;               // page content
+        unsigned pinCount = 0;              // number of users currently holding the page
+        bool valid = false;                 // whether the frame holds a page
+        bool dirty = false;                 // whether the page differs from the one on disk
+        bool useOnce = false;               // loaded by a sequential scan, evicted before other unpinned pages
+        std::list<unsigned>::iterator lruPos;
+    } Frame;
+
+    // Buffer pool shared by every open file, LRU replacement over unpinned frames.
+    // Pages brought in by sequential scans are queued for eviction first, so a scan recycles a few frames
+    // instead of flushing out catalog and index pages
+    class BufferPool {
+    public:
+        unsigned hitCounter;
+        unsigned missCounter;
+
+        explicit BufferPool(unsigned numberOfFrames);                       // Allocate numberOfFrames frames
+        ~BufferPool();                                                      // Write back dirty pages and free all frames
+
+        unsigned registerFile(const std::string &fileName);                // Get the id of a file being opened
+        void unregisterFile(const std::string &fileName, unsigned fileId); // Release a file being closed, dropping its pages on last close
+        bool isOpen(const std::string &fileName);                           // Whether any handle is open on a file
+        void dropPages(unsigned fileId, PageNum firstPageNum);              // Forget the cached pages of a file from firstPageNum on
+
+        char *pinPage(FileHandle &fileHandle, PageNum pageNum, bool load, bool useOnce = false);    // Pin a page, reading it from disk on a miss if load is set
+        char *pinResidentPage(FileHandle &fileHandle, PageNum pageNum);     // Pin a page only if it is already cached
+        RC unpinPage(FileHandle &fileHandle, PageNum pageNum, bool dirty);  // Release a pin, marking the page dirty if modified
+        RC flushFile(FileHandle &fileHandle);                               // Write back every dirty page of the file a handle is open on
+        RC flushPages(unsigned fileId);                                     // Write back every dirty page of a file, whichever handle dirtied it
+        void bumpWriteVersion(unsigned fileId);                             // Record a page write to a file
+        unsigned getWriteVersion(unsigned fileId);                          // Get the number of page writes made to a file through any handle
+        unsigned getWriteCount(unsigned fileId);                            // Get the number of dirty pages of a file written back by the pool
+
+        unsigned getNumberOfFrames();                                       // Get the number of frames in the pool
+        RC setNumberOfFrames(unsigned numberOfFrames);                      // Resize the pool, no page may be pinned
+        RC collectCounterValues(unsigned &hitCount, unsigned &missCount);   // Put current hit and miss counts into variables
+
+    private:
+        std::vector<Frame> frames;
+        std::list<unsigned> lruList;                                        // unpinned valid frames, least recently used first
+        std::vector<unsigned> freeFrames;                                   // frames holding no page
+        std::unordered_map<unsigned long long, unsigned> pageTable;         // (file id, page num) to frame index
+        std::unordered_map<std::string, std::pair<unsigned, unsigned>> files;   // file name to (file id, open count)
+        std::unordered_map<unsigned, unsigned> writeVersions;               // file id to number of page writes while open
+        std::unordered_map<unsigned, unsigned> writeCounts;                 // file id to number of dirty pages written back while open
+        std::unordered_map<unsigned, std::FILE *> streams;                  // file id to the pool's own stream dirty pages are written back through
+        unsigned nextFileId;
+
+        static unsigned long long getPageKey(unsigned fileId, PageNum pageNum);
+        RC flushFrame(Frame &frame);                                        // Write a dirty frame through the stream of its file
+        void releaseFrame(unsigned frameIndex);                             // Drop the page held by a frame
+        int getVictimFrame();                                               // Get a frame to hold a new page, -1 if none can be freed
+        void dropFileId(unsigned fileId);                                   // Drop every page of a file id
+    };
+
     class PagedFileManager {
     public:
         static PagedFileManager &instance();                                // Access to the singleton instance
 
-        RC createFile(const std::string &fileName);                         // Create a new file
+        RC createFile(const std::string &fileName,
+                      bool freeSpaceMap = false);                           // Create a new file, with hidden free-space pages if set
+        RC createTempFile(const std::string &prefix, std::string &fileName,
+                          bool freeSpaceMap = false);                       // Create a file under a new unique name starting with
+                                                                            //   TEMP_FILE_PREFIX and prefix, put into fileName
         RC destroyFile(const std::string &fileName);                        // Destroy a file
-        RC openFile(const std::string &fileName, FileHandle &fileHandle);   // Open a file
+        RC openFile(const std::string &fileName, FileHandle &fileHandle,
+                    bool mapped = false);                                   // Open a file, memory-mapped for reading if mapped is set
         RC closeFile(FileHandle &fileHandle);                               // Close a file
 
+        BufferPool &getBufferPool();                                        // Access to the shared buffer pool
+
     protected:
+        BufferPool *bufferPool;
+
+        static RC initFile(std::FILE *pFile, bool freeSpaceMap);            // Write the header page of a new empty file
+
         PagedFileManager();                                                 // Prevent construction
         ~PagedFileManager();                                                // Prevent unwanted destruction
         PagedFileManager(const PagedFileManager &);                         // Prevent construction by copying
@@ -37,11 +114,16 @@ namespace PeterDB {
     class FileHandle {
     public:
         std::FILE *pFile = nullptr;
+        std::string fileName;
+        unsigned fileId;
         unsigned numberOfPages;
+        unsigned freeSpaceSpan = 0;                                         // data pages per free-space page, 0 if the file has no map
         // variables to keep the counter for each operation
         unsigned readPageCounter;
         unsigned writePageCounter;
         unsigned appendPageCounter;
+        unsigned writeCalls = 0;                                            // writePage calls made through this handle
+        unsigned poolWrites = 0;                                            // write-backs of the file by the pool already in writePageCounter
 
         //version variables
         unsigned version;
@@ -51,6 +133,14 @@ namespace PeterDB {
         void *recordBuffer = nullptr;
         unsigned short recordLength;
 
+        //write-back variables
+        bool writeBack = false;                                             // keep written pages dirty in the buffer pool until flushed
+        bool sequential = false;                                            // pages read are used once, do not keep them cached
+
+        //memory-mapped read variables
+        char *mappedData = nullptr;
+        size_t mappedSize = 0;
+
         FileHandle();                                                       // Default constructor
         ~FileHandle();                                                      // Destructor
 
@@ -58,9 +148,28 @@ namespace PeterDB {
         RC readPage(PageNum pageNum, void *data);                           // Get a specific page
         RC writePage(PageNum pageNum, const void *data);                    // Write a specific page
         RC appendPage(const void *data);                                    // Append a specific page
+        RC truncate(unsigned numberOfPages);                                // Drop every page from numberOfPages on, shrinking the file
+        RC flush();                                                         // Write back every dirty page of the file and merge the header
         unsigned getNumberOfPages();                                        // Get the number of pages in the file
         RC collectCounterValues(unsigned &readPageCount, unsigned &writePageCount,
                                 unsigned &appendPageCount);                 // Put current counter values into variables
+
+        PageNum getFilePageNum(PageNum pageNum);                            // Get the position of a data page among all pages after the header
+        unsigned getNumberOfFilePages();                                    // Get the number of pages after the header, hidden ones included
+        RC readPageFromDisk(PageNum filePageNum, void *data);               // Read a file page bypassing the buffer pool
+        RC writePageToDisk(PageNum filePageNum, const void *data);          // Write a file page bypassing the buffer pool
+        void collectPoolWrites();                                           // Add the pages the pool wrote back since the last call to writePageCounter
+
+        bool hasFreeSpaceMap();                                             // Whether the file keeps a free-space map
+        RC setPageFreeSpace(PageNum pageNum, unsigned short freeSpace);     // Record the free bytes of a data page
+        PageNum findPageWithFreeSpace(unsigned short freeSpace);            // Get a page with at least freeSpace bytes, numberOfPages if none
+
+        RC mapFile();                                                       // Map the whole file read-only
+        RC unmapFile();                                                     // Release the mapping
+        bool isMapped();                                                    // Whether the file is memory-mapped
+        const char *getPagePointer(PageNum pageNum);                        // Get a specific page in place, nullptr if not mapped
+
+        unsigned getWriteVersion();                                         // Get the number of page writes made to the file through any handle
     };
 
 } // namespace PeterDB
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <limits>
+#include <algorithm>
 #include <unordered_map>
 #include <cassert>
 
@@ -13,6 +14,17 @@
 namespace PeterDB {
 
 #define QE_EOF (-1)  // end of the index scan
+
+#define INDEX_SCAN_BATCH_SIZE 256  // index entries IndexScan takes from the index per call
+
+#define BNLJOIN_INNER_PAGES 8  // most pages of numPages BNLJoin gives to each chunk of the inner input
+
+#define INLJOIN_BATCH_PAGES 16  // pages of outer tuples INLJoin looks up in the index in key order, and most pages of
+                                //   inner tuples it keeps for one key
+
+#define GHJOIN_BUILD_PAGES 64  // pages of a left partition GHJoin holds in memory at once
+
+#define GHJOIN_MAX_DEPTH 3  // times GHJoin repartitions an oversized partition before joining it block by block
     typedef enum AggregateOp {
         MIN = 0, MAX, COUNT, SUM, AVG
     } AggregateOp;
@@ -83,6 +95,63 @@ namespace PeterDB {
             }
             return tupleLength;
         }
+
+        // Offset of an attribute in a tuple, -1 if it is null
+        int getAttrOffset(const char *tupleBuffer, const std::vector<Attribute> &attrs, int attrPos, int bitmapBytes) {
+            if (tupleBuffer[attrPos / 8] >> (7 - attrPos % 8) & (unsigned) 1) return -1;
+            int offset = bitmapBytes, length;
+            for (int i = 0; i < attrPos; i++) {
+                if (tupleBuffer[i / 8] >> (7 - i % 8) & (unsigned) 1) continue;
+                length = 0;
+                if (attrs[i].type == 2) std::memcpy(&length, tupleBuffer + offset, sizeof(int));
+                offset = offset + sizeof(int) + length;
+            }
+            return offset;
+        }
+
+        // Compare two values of an attribute type, negative if the first one is smaller
+        static int compareAttrs(const char *value, const char *other, AttrType type) {
+            switch (type) {
+                case 0: {
+                    int intValue, intOther;
+                    std::memcpy(&intValue, value, sizeof(int));
+                    std::memcpy(&intOther, other, sizeof(int));
+                    return intValue < intOther ? -1 : intValue > intOther;
+                }
+                case 1: {
+                    float floatValue, floatOther;
+                    std::memcpy(&floatValue, value, sizeof(float));
+                    std::memcpy(&floatOther, other, sizeof(float));
+                    return floatValue < floatOther ? -1 : floatValue > floatOther;
+                }
+                default: {
+                    int length, otherLength;
+                    std::memcpy(&length, value, sizeof(int));
+                    std::memcpy(&otherLength, other, sizeof(int));
+                    int cmp = std::memcmp(value + sizeof(int), other + sizeof(int), std::min(length, otherLength));
+                    if (cmp != 0) return cmp;
+                    return length < otherLength ? -1 : length > otherLength;
+                }
+            }
+        }
+
+        // Hash a value of an attribute type, values comparing equal hash the same
+        static unsigned hashAttr(const char *value, AttrType type) {
+            int length = sizeof(int);
+            float floatValue, zero = 0;
+            if (type == 2) {
+                std::memcpy(&length, value, sizeof(int));
+                value = value + sizeof(int);
+            } else if (type == 1) {
+                // -0 equals 0 but has other bits
+                std::memcpy(&floatValue, value, sizeof(float));
+                if (floatValue == 0) value = (const char *) &zero;
+            }
+            unsigned hash = 2166136261u;
+            for (int i = 0; i < length; i++) hash = (hash ^ (unsigned char) value[i]) * 16777619u;
+            hash = (hash ^ (hash >> 16)) * 0x45d9f3bu;
+            return hash ^ (hash >> 16);
+        }
     };
 
     class TableScan : public Iterator {
@@ -149,11 +218,27 @@ namespace PeterDB {
         std::string tableName;
         std::string attrName;
         std::vector<Attribute> attrs;
-        char key[PAGE_SIZE];
-        RID rid;
+        std::vector<RID> rids;          // rids of the current batch of index entries
+        unsigned ridIndex = 0;          // next rid of the batch to fetch
+        bool heapOrder;                 // return tuples in heap order, every rid of the key range collected up front
+        bool collected = false;         // whether the rids of the key range have been collected
+
+        // Collect every rid in the key range sorted by page, so each heap page is read once
+        RC collectRids() {
+            std::vector<RID> batch;
+            while (iter.getNextEntries(batch, nullptr, INDEX_SCAN_BATCH_SIZE) == 0) {
+                rids.insert(rids.end(), batch.begin(), batch.end());
+            }
+            std::sort(rids.begin(), rids.end(), [](const RID &rid, const RID &other) {
+                return rid.pageNum < other.pageNum || (rid.pageNum == other.pageNum && rid.slotNum < other.slotNum);
+            });
+            collected = true;
+            return rids.empty() ? QE_EOF : 0;
+        };
+
     public:
         IndexScan(RelationManager &rm, const std::string &tableName, const std::string &attrName,
-                  const char *alias = nullptr) : rm(rm) {
+                  const char *alias = nullptr, bool heapOrder = false) : rm(rm), heapOrder(heapOrder) {
             // Set members
             this->tableName = tableName;
             this->attrName = attrName;
@@ -168,18 +253,27 @@ namespace PeterDB {
             if (alias) this->tableName = alias;
         };
 
-        // Start a new iterator given the new key range
+        // Start a new iterator given the new key range, moving the open index scan there if there is one
         void setIterator(void *lowKey, void *highKey, bool lowKeyInclusive, bool highKeyInclusive) {
-            iter.close();
-            rm.indexScan(tableName, attrName, lowKey, highKey, lowKeyInclusive, highKeyInclusive, iter);
+            if (iter.seek(lowKey, highKey, lowKeyInclusive, highKeyInclusive) != 0) {
+                iter.close();
+                rm.indexScan(tableName, attrName, lowKey, highKey, lowKeyInclusive, highKeyInclusive, iter);
+            }
+            rids.clear();
+            ridIndex = 0;
+            collected = false;
         };
 
         RC getNextTuple(void *data) override {
-            RC rc = iter.getNextEntry(rid, key);
-            if (rc == 0) {
-                rc = rm.readTuple(tableName, rid, data);
+            if (ridIndex == rids.size()) {
+                if (collected) return QE_EOF;
+                rids.clear();
+                RC rc = heapOrder ? collectRids() : iter.getNextEntries(rids, nullptr, INDEX_SCAN_BATCH_SIZE);
+                if (rc != 0) return rc;
+                ridIndex = 0;
             }
-            return rc;
+            RID &rid = rids[ridIndex++];
+            return rm.readTuple(tableName, rid, data);
         };
 
         RC getAttributes(std::vector<Attribute> &attributes) const override {
@@ -194,6 +288,11 @@ namespace PeterDB {
             return 0;
         };
 
+        // Whether tuples come in ascending order of the attribute named rel.attr
+        bool isOrderedOn(const std::string &name) const {
+            return !heapOrder && tableName + "." + attrName == name;
+        };
+
         ~IndexScan() override {
             iter.close();
         };
@@ -240,21 +339,101 @@ namespace PeterDB {
         RC getAttributes(std::vector<Attribute> &attrs) const override;
     };
 
+    typedef struct SortKey {
+        std::string attrName;       // attribute to sort on, named rel.attr
+        bool ascending;             // nulls come first in ascending order and last in descending order
+    } SortKey;
+
+    class Sort : public Iterator {
+        RecordBasedFileManager &rbfm;
+        Iterator *input;
+        const unsigned int numPages;
+        const unsigned int limit;
+        unsigned returned = 0;
+        RC sortRC = 0;
+        std::vector<Attribute> attrs;
+        std::vector<std::string> attrNames;
+        std::vector<std::pair<int, bool>> keys;             // (position, ascending) of each sort key, the first one compared first
+        int attrsSize, bitmapBytes, maxTupleLength;
+        void *bitmap = nullptr, *runBuffer = nullptr, *tupleBuffer = nullptr;
+        std::vector<std::pair<int, int>> runDirectory;      // (offset, length) of the tuples of the run buffer in sorted order
+        unsigned runIndex = 0;
+        bool inMemory = false;                              // the input fit in one run, returned from the run buffer
+        std::vector<std::string> runFileNames;              // runs on disk not merged yet
+        std::vector<RBFM_ScanIterator *> mergeScans;        // scans of the runs being merged
+        std::vector<char *> mergeTuples;                    // next tuple of each run being merged
+        std::vector<bool> mergeDone;                        // whether each run being merged has no tuples left
+        std::vector<unsigned> loserTree;                    // loser of each inner node of the merge tree, the winner at 0
+
+        int compareTuples(const char *tuple, const char *other);
+
+        bool mergesBefore(unsigned run, unsigned other);    // run count stands for a run before every other one
+
+        void adjustLoserTree(unsigned run);
+
+        void fillRunBuffer(bool &inputHasNext);
+
+        RC selectTopK();
+
+        RC createRun(std::string &fileName, FileHandle &fileHandle);
+
+        RC writeRun();
+
+        RC openMerge(unsigned first, unsigned count);
+
+        RC nextMerged(void *data);
+
+        void closeMerge();
+
+        RC sortInput();
+
+        // External merge sort operator, spilling sorted runs to temporary files
+    public:
+        Sort(Iterator *input,                   // Iterator of input R
+             const std::vector<SortKey> &keys,  // Sort keys, later ones break ties of earlier ones
+             const unsigned numPages,           // # of pages a run takes in memory, the merge fan-in is one less
+             const unsigned limit = 0           // # of tuples returned at most, 0 for all of them
+        );
+
+        Sort(Iterator *input,                   // Iterator of input R
+             const std::string &attrName,       // Attribute to sort on in ascending order
+             const unsigned numPages            // # of pages a run takes in memory, the merge fan-in is one less
+        );
+
+        ~Sort() override;
+
+        RC getNextTuple(void *data) override;
+
+        // For attribute in std::vector<Attribute>, name it as rel.attr
+        RC getAttributes(std::vector<Attribute> &attrs) const override;
+    };
+
+    // Entry of the BNLJoin hash table, offset -1 if the slot is empty
+    typedef struct JoinSlot {
+        unsigned hash;                  // hash of the join key
+        int offset;                     // offset of the tuple in the outer buffer
+    } JoinSlot;
+
     class BNLJoin : public Iterator {
         Iterator *outer;
         TableScan *inner;
         const Condition &cond;
         const unsigned int numPages;
+        unsigned innerPages, outerPages;        // shares of numPages for the inner chunk and the outer block
         std::vector<Attribute> attrs, leftAttrs, rightAttrs;
         int leftAttrsSize, rightAttrsSize, attrsSize, leftBitmapBytes, rightBitmapBytes, bitmapBytes, innerAttrPos = -1, outerAttrPos = -1;
         void *leftBitmap = nullptr, *rightBitmap = nullptr, *bitmap = nullptr, *innerBuffer = nullptr, *outerBuffer = nullptr, *innerTupleBuffer = nullptr, *outerTupleBuffer = nullptr;
-        std::unordered_map<int, std::vector<std::pair<int, int>>> intHm;
-        std::unordered_map<float, std::vector<std::pair<int, int>>> floatHm;
-        std::unordered_map<std::string, std::vector<std::pair<int, int>>> varCharHm;
-        bool innerHasNext = false, outerHasNext = true, outerFillingStarted = false;
-        int innerBufferIndex = 0, outerBufferIndex = 0;
+        std::vector<JoinSlot> outerEntries;     // tuples of the outer buffer, placed into the hash table once the buffer is full
+        JoinSlot *table = nullptr;              // open-addressing hash table at the end of the outer buffer
+        JoinSlot *spareTable = nullptr;         // table of a block whose one tuple leaves no room for it in the outer buffer
+        unsigned tableMask = 0;                 // slots in the table less one, the count being a power of two
+        bool innerHasNext = false, outerHasNext = true, outerFillingStarted = false, probing = false;
+        unsigned innerBufferIndex = 0, probeSlot = 0, probeHash = 0;
+        int probeKeyOffset = 0;
         std::vector<std::pair<int, int>> innerBufferDirectory;
 
+        static unsigned getTableSize(unsigned entries);     // slots of a table holding entries at most three quarters full
+
         void fillInnerBuffer();
 
         RC fillOuterBuffer();
@@ -284,10 +463,24 @@ namespace PeterDB {
         const Condition &cond;
         std::vector<Attribute> attrs, outerAttrs, innerAttrs;
         int attrsSize, outerAttrsSize, innerAttrsSize, outerBitmapBytes, innerBitmapBytes, bitmapBytes, outerAttrPos = -1, innerAttrPos = -1;
-        void *outerBitmap = nullptr, *innerBitmap = nullptr, *bitmap = nullptr, *innerTupleBuffer = nullptr, *outerTupleBuffer = nullptr;
-        bool innerHasNext = false;
+        void *outerBitmap = nullptr, *innerBitmap = nullptr, *bitmap = nullptr, *innerTupleBuffer = nullptr, *outerTupleBuffer = nullptr, *outerBuffer = nullptr;
+        std::vector<std::pair<int, int>> outerBufferDirectory;     // (offset, length) of the outer tuples of the batch in key order
+        unsigned outerBufferIndex = 0;
+        bool outerHasNext = true, outerFillingStarted = false, probed = false;
+        std::vector<char> matchKey;                                 // key last looked up, empty if none
+        std::vector<char> matches;                                  // inner tuples found for matchKey, up to INLJOIN_BATCH_PAGES pages
+        std::vector<std::pair<int, int>> matchDirectory;            // (offset, length) of the tuples in matches
+        unsigned matchIndex = 0;
+        bool matchesLeft = false;                                   // whether the index scan may hold more tuples of matchKey
+        bool matchesWhole = false;                                  // whether matches holds every inner tuple of matchKey
+
+        RC fillOuterBuffer();
 
-        void joinTuples(void *data);
+        void probe(const char *key);        // find the inner tuples of a key unless they are those of the last one
+
+        void fillMatches();                 // take the next inner tuples of matchKey from the index scan
+
+        void joinTuples(int outerOffset, int outerLength, int innerOffset, int innerLength, void *data);
 
         // Index nested-loop join operator
     public:
@@ -304,8 +497,105 @@ namespace PeterDB {
         RC getAttributes(std::vector<Attribute> &attrs) const override;
     };
 
+    class SMJoin : public Iterator {
+        RecordBasedFileManager &rbfm;
+        Iterator *left, *right;                         // inputs in join key order
+        Sort *leftSort = nullptr, *rightSort = nullptr; // sorts of the inputs not already in join key order
+        const Condition &cond;
+        const unsigned int numPages;
+        std::vector<Attribute> attrs, leftAttrs, rightAttrs;
+        std::vector<std::string> rightAttrNames;
+        int leftAttrsSize, rightAttrsSize, attrsSize, leftBitmapBytes, rightBitmapBytes, bitmapBytes, leftAttrPos = -1, rightAttrPos = -1;
+        void *leftBitmap = nullptr, *rightBitmap = nullptr, *bitmap = nullptr, *leftTupleBuffer = nullptr, *rightTupleBuffer = nullptr;
+        void *groupBuffer = nullptr, *groupKey = nullptr, *groupTupleBuffer = nullptr;
+        int leftLength = 0, rightLength = 0, leftKeyOffset = -1, rightKeyOffset = -1, groupKeyOffset = -1, groupLength = 0;
+        std::vector<std::pair<int, int>> groupDirectory;        // (offset, length) of the right tuples of the current key in groupBuffer
+        unsigned groupIndex = 0;
+        bool started = false, leftHasNext = false, rightHasNext = false, grouped = false;
+        bool groupSpilled = false;                              // the group outgrew groupBuffer and is read from its file
+        std::string groupFileName;
+        FileHandle groupHandle;
+        RBFM_ScanIterator groupScan;
+
+        bool nextLeft();        // skips tuples with a null join key
+
+        bool nextRight();
+
+        RC spillGroup();
+
+        RC readGroup();
+
+        RC startGroup();
+
+        void closeGroup();
+
+        void joinTuples(const char *rightTuple, int rightLength, void *data);
+
+        // Sort-merge join operator
+    public:
+        SMJoin(Iterator *leftIn,                // Iterator of input R
+               Iterator *rightIn,               // Iterator of input S
+               const Condition &condition,      // Join condition (CompOp is always EQ)
+               const unsigned numPages          // # of pages the sorts can use, split between the inputs that need sorting,
+                                                // and the right tuples of one key can hold before they spill to a file
+        );
+
+        ~SMJoin() override;
+
+        RC getNextTuple(void *data) override;
+
+        // For attribute in std::vector<Attribute>, name it as rel.attr
+        RC getAttributes(std::vector<Attribute> &attrs) const override;
+    };
+
+    // A pair of GHJoin partition files, depth counts the repartitions that produced it
+    typedef struct GHJoinPartition {
+        std::string leftFileName, rightFileName;
+        unsigned depth;
+    } GHJoinPartition;
+
     // 10 extra-credit points
     class GHJoin : public Iterator {
+        RecordBasedFileManager &rbfm;
+        const Condition &cond;
+        const unsigned int numPartitions;
+        RC partitionRC = 0;
+        std::vector<Attribute> attrs, leftAttrs, rightAttrs;
+        std::vector<std::string> leftAttrNames, rightAttrNames;
+        int leftAttrsSize, rightAttrsSize, attrsSize, leftBitmapBytes, rightBitmapBytes, bitmapBytes, leftAttrPos = -1, rightAttrPos = -1;
+        void *leftBitmap = nullptr, *rightBitmap = nullptr, *bitmap = nullptr, *buildBuffer = nullptr, *buildTupleBuffer = nullptr, *probeTupleBuffer = nullptr;
+        std::unordered_map<int, std::vector<std::pair<int, int>>> intHm;
+        std::unordered_map<float, std::vector<std::pair<int, int>>> floatHm;
+        std::unordered_map<std::string, std::vector<std::pair<int, int>>> varCharHm;
+        std::vector<std::string> fileNames;             // every partition file still on disk, destroyed with the join
+        std::vector<GHJoinPartition> partitions;        // partitions still to join, the last one first
+        GHJoinPartition partition;                      // partition being joined
+        RBFM_ScanIterator buildScan, probeScan;
+        bool joining = false, buildHasNext = false;
+        std::vector<std::pair<int, int>> *matches = nullptr;
+        unsigned matchIndex = 0;
+        int probeLength = 0;
+
+        int getPartition(char *tupleBuffer, bool left, unsigned depth);     // -1 if the join key is null
+
+        RC createPartitions(unsigned depth, std::vector<FileHandle *> &leftHandles, std::vector<FileHandle *> &rightHandles);
+
+        RC closePartitions(std::vector<FileHandle *> &handles);
+
+        RC partitionInputs(Iterator *leftIn, Iterator *rightIn);
+
+        RC repartition(const GHJoinPartition &oversized);
+
+        RC openScan(const std::string &fileName, bool left, RBFM_ScanIterator &scanIterator);
+
+        RC nextPartition();
+
+        void fillBuildBuffer();
+
+        void probe();
+
+        void joinTuples(int leftOffset, int leftLength, void *data);
+
         // Grace hash join operator
     public:
         GHJoin(Iterator *leftIn,               // Iterator of input R
@@ -5,6 +5,12 @@
 #include <vector>
 #include <ostream>
 #include <cstring>
+#include <climits>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include "pfm.h"
 
@@ -12,6 +18,12 @@ namespace PeterDB {
 
 #define RBFM_EOF (-1)
 
+#define RECORD_TOMBSTONE 1  // record flag: the slot holds the RID the record was moved to
+#define RECORD_MOVED 2      // record flag: the record is only reachable through a tombstone
+
+#define PARALLEL_SCAN_MORSEL_SIZE 16        // pages a worker claims at a time
+#define PARALLEL_SCAN_QUEUE_SIZE 64         // morsels buffered ahead of the consumer
+
     typedef unsigned short SlotNum;
 
     //Slot Directory
@@ -59,6 +71,33 @@ namespace PeterDB {
         NO_OP       // no condition
     } CompOp;
 
+    // One condition of a multi-condition scan
+    typedef struct ScanCondition {
+        std::string attribute;      // condition attribute
+        CompOp compOp;              // comparison type such as "<" and "="
+        const void *value;          // used in the comparison, same format as the value of scan()
+
+        ScanCondition() {};
+        ScanCondition(std::string attribute, CompOp compOp, const void *value): attribute(std::move(attribute)), compOp(compOp), value(value) {};
+    } ScanCondition;
+
+    // Compare a field with a condition value, both given as raw bytes without any length prefix
+    typedef bool (*FieldComparator)(const char *field, unsigned short fieldLength, const char *value, unsigned short valueLength);
+
+    // Scan condition compiled once into a comparator specialised by attribute type and operator
+    typedef struct Predicate {
+        int attrIndex = -1;                         // descriptor index of the condition attribute, -1 if no condition
+        bool unsatisfiable = false;                 // the condition attribute is not in the descriptor
+        FieldComparator comparator = nullptr;       // nullptr if any non-null value satisfies the condition
+        std::vector<char> value;
+
+        // Compile the condition against a record descriptor.
+        RC compile(const std::vector<Attribute> &recordDescriptor, const std::string &conditionAttribute, CompOp compOp, const void *value);
+
+        // Whether a record whose fields were located by RBFM_ScanIterator::decodeFields() satisfies the condition.
+        bool evaluate(const char *recordBuffer, const std::vector<unsigned short> &fieldStarts, const std::vector<unsigned short> &fieldEnds) const;
+    } Predicate;
+
 
     /********************************************************************
     * The scan iterator is NOT required to be implemented for Project 1 *
@@ -81,14 +120,28 @@ namespace PeterDB {
 
         FileHandle fileHandle;
 
-        std::vector<RID> rids;
+        RID cursor;         // next (page, slot) to examine
+
+        PageNum endPageNum = UINT_MAX;      // the cursor stops before this page
 
-        int pos;
+        unsigned recordSize = 0;            // bytes written by the last getNextRecord()
 
         std::vector<Attribute> recordDescriptor;
 
         std::vector<std::string> attributeNames;
 
+        std::vector<int> projection;        // descriptor index of each projected attribute, -1 if unknown
+
+        std::vector<unsigned short> fieldStarts, fieldEnds;     // byte range of each field in the record buffer, end 0 if null
+
+        std::vector<std::vector<Predicate>> predicates;     // disjunction of conjunctions, empty if every record matches
+
+        // Whether the decoded record buffer satisfies the scan conditions.
+        bool isMatch();
+
+        // Locate every field of the record buffer in one pass over its offset directory.
+        void decodeFields();
+
         // Never keep the results in the memory. When getNextRecord() is called,
         // a satisfying record needs to be fetched from the file.
         // "data" follows the same format as RecordBasedFileManager::insertRecord().
@@ -97,20 +150,73 @@ namespace PeterDB {
         RC close();
     };
 
+    //  RBFM_ParallelScanIterator runs a scan on worker threads, each working through morsels of
+    //  PARALLEL_SCAN_MORSEL_SIZE pages with its own memory-mapped handle. Each morsel's results are handed
+    //  over as one batch, so the lock is taken once per morsel. Results arrive in no particular order.
+    class RBFM_ParallelScanIterator {
+    public:
+        RBFM_ParallelScanIterator() = default;
+
+        ~RBFM_ParallelScanIterator();
+
+        std::vector<RBFM_ScanIterator> scanIterators;       // one per worker
+
+        std::vector<std::thread> workers;
+
+        std::atomic<unsigned> nextPageNum;                  // first page of the next unclaimed morsel
+
+        unsigned numberOfPages = 0;
+
+        std::mutex mutex;
+
+        std::condition_variable notEmpty, notFull;
+
+        struct Batch {
+            std::vector<char> data;                         // the morsel's records back to back
+            std::vector<std::pair<RID, unsigned>> rows;     // rid and end offset in data of each record
+        };
+
+        std::deque<Batch> batches;
+
+        Batch current;                                      // batch the consumer is reading, owned by it
+
+        unsigned currentRow = 0;
+
+        unsigned runningWorkers = 0;
+
+        bool stopped = false;
+
+        // Scan morsels with the worker's iterator until the file is exhausted or the scan is closed.
+        void work(unsigned workerIndex, unsigned dataSize);
+
+        // "data" follows the same format as RBFM_ScanIterator::getNextRecord().
+        RC getNextRecord(RID &rid, void *data);
+
+        RC close();
+    };
+
     class RecordBasedFileManager {
     public:
         static RecordBasedFileManager &instance();                          // Access to the singleton instance
 
-        RC createFile(const std::string &fileName);                         // Create a new record-based file
+        RC createFile(const std::string &fileName,
+                      bool freeSpaceMap = true);                            // Create a new record-based file, without a map records are
+                                                                            //   only ever appended and scan back in insertion order
+
+        RC createTempFile(const std::string &prefix, std::string &fileName);    // Create a record-based file without a map
+                                                                            //   under a new unique name, put into fileName
 
         RC destroyFile(const std::string &fileName);                        // Destroy a record-based file
 
-        RC openFile(const std::string &fileName, FileHandle &fileHandle);   // Open a record-based file
+        RC openFile(const std::string &fileName, FileHandle &fileHandle,
+                    bool mapped = false);                                   // Open a record-based file, read-only scans may map it
 
         RC closeFile(FileHandle &fileHandle);                               // Close a record-based file
 
         RC getPageBuffer(FileHandle &fileHandle, unsigned pageNum);          // Load page pageNum to the page buffer
 
+        RC writePageBuffer(FileHandle &fileHandle, unsigned pageNum);       // Write the page buffer back and record its free space
+
         RC appendEmptyPage(FileHandle &fileHandle);                         // Append a structured empty page to the end of the paged file
 
         unsigned short getFreeSpace(FileHandle &fileHandle);                // Get the free space of current page
@@ -133,6 +239,10 @@ namespace PeterDB {
 
         RC getRecordBuffer(FileHandle &fileHandle, const RID &rid, bool recursive);         // Get the record from file to buffer
 
+        unsigned char getRecordFlag(FileHandle &fileHandle);                 // Get the flag byte of the record buffer
+
+        bool getForwardRID(FileHandle &fileHandle, RID &rid);               // Get the RID a tombstone in the record buffer points to
+
         RC toData(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor, void *data);      // Transform record buffer to data
 
         void increaseVersion(FileHandle &fileHandle);
@@ -158,6 +268,9 @@ namespace PeterDB {
         RC insertRecord(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor, const void *data,
                         RID &rid);
 
+        // Insert the record buffer into a page with enough free space
+        RC insertRecordBuffer(FileHandle &fileHandle, RID &rid);
+
         // Read a record identified by the given rid.
         RC
         readRecord(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor, const RID &rid, void *data);
@@ -196,6 +309,28 @@ namespace PeterDB {
                 const std::vector<std::string> &attributeNames, // a list of projected attributes
                 RBFM_ScanIterator &rbfm_ScanIterator);
 
+        // Scan records satisfying every condition.
+        RC scan(FileHandle &fileHandle,
+                const std::vector<Attribute> &recordDescriptor,
+                const std::vector<ScanCondition> &conditions,
+                const std::vector<std::string> &attributeNames,
+                RBFM_ScanIterator &rbfm_ScanIterator);
+
+        // Scan records satisfying any of the conjunctions.
+        RC scan(FileHandle &fileHandle,
+                const std::vector<Attribute> &recordDescriptor,
+                const std::vector<std::vector<ScanCondition>> &disjunction,
+                const std::vector<std::string> &attributeNames,
+                RBFM_ScanIterator &rbfm_ScanIterator);
+
+        // Scan a file on numberOfWorkers threads, records satisfying any of the conjunctions.
+        RC parallelScan(const std::string &fileName,
+                        const std::vector<Attribute> &recordDescriptor,
+                        const std::vector<std::vector<ScanCondition>> &disjunction,
+                        const std::vector<std::string> &attributeNames,
+                        unsigned numberOfWorkers,
+                        RBFM_ParallelScanIterator &rbfm_ParallelScanIterator);
+
     protected:
         RecordBasedFileManager();                                                   // Prevent construction
         ~RecordBasedFileManager();                                                  // Prevent unwanted destruction
@@ -44,6 +44,20 @@ namespace PeterDB {
 #define ERR_INDEX_DELETE_ON_NON_EXISTS_INDEX 31
 #define ERR_INDEX_SCAN_ON_NON_EXISTS_COL 32
 #define ERR_INDEX_SCAN_ON_NON_EXISTS_INDEX 33
+
+#define ERR_BUFFER_POOL_FULL 34
+#define ERR_BUFFER_PAGE_PINNED 35
+#define ERR_BUFFER_PAGE_NOT_PINNED 36
+
+#define ERR_FILE_MAP_FAILED 37
+#define ERR_FILE_UNMAP_FAILED 38
+#define ERR_FILE_TRUNCATE_FAILED 39
+
+#define ERR_INDEX_COMPACT_ON_NON_EXISTS_COL 40
+#define ERR_INDEX_COMPACT_ON_NON_EXISTS_INDEX 41
+
+#define ERR_FILE_IN_USE 42
+#define ERR_TABLE_NAME_RESERVED 43
 }
 
 #endif // _rc_h_
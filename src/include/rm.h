@@ -3,6 +3,9 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <list>
+#include <unordered_map>
 
 #include "ix.h"
 
@@ -18,6 +21,8 @@ namespace PeterDB {
 
 #define indexSuffix ".idx"
 
+#define TABLE_HANDLE_CACHE_SIZE 64  // open file descriptors kept by the table handle cache
+
     // RM_ScanIterator is an iterator to go through tuples
     class RM_ScanIterator {
     public:
@@ -33,6 +38,21 @@ namespace PeterDB {
         RC close();
     };
 
+    // RM_ParallelScanIterator is an iterator to go through tuples found by worker threads, in no particular order
+    class RM_ParallelScanIterator {
+    public:
+        RBFM_ParallelScanIterator rbfm_ParallelScanIterator;
+
+        RM_ParallelScanIterator();
+
+        ~RM_ParallelScanIterator();
+
+        // "data" follows the same format as RelationManager::insertTuple()
+        RC getNextTuple(RID &rid, void *data);
+
+        RC close();
+    };
+
     // RM_IndexScanIterator is an iterator to go through index entries
     class RM_IndexScanIterator {
     public:
@@ -44,14 +64,39 @@ namespace PeterDB {
 
         // "key" follows the same format as in IndexManager::insertEntry()
         RC getNextEntry(RID &rid, void *key);    // Get next matching entry
+        RC getNextEntries(std::vector<RID> &rids, void *keys, unsigned maxCount);    // Get up to maxCount next matching entries
+        RC seek(const void *lowKey, const void *highKey,
+                bool lowKeyInclusive, bool highKeyInclusive);    // Restart an open scan at a new key range
         RC close();                              // Terminate index scan
     };
 
+    // Catalog entries of a table, loaded on first use
+    typedef struct TableCatalog {
+        int tableId = -1;
+        std::map<int, std::pair<std::vector<Attribute>, std::vector<int>>> versions;    // version to (attributes, positions)
+        bool indexesLoaded = false;
+        std::vector<std::pair<int, RID>> indexes;                                       // (column position, rid in Indexes) of indexed columns
+    } TableCatalog;
+
+    // Handles of a table kept open across calls
+    typedef struct TableHandle {
+        FileHandle fileHandle;
+        std::unordered_map<int, IXFileHandle *> ixFileHandles;     // column position to open index handle
+        unsigned refCount = 0;                                      // number of callers currently using the handles
+        std::list<std::string>::iterator lruPos;
+    } TableHandle;
+
     // Relation Manager
     class RelationManager {
     private:
         void *tableIdBuffer, *attributesBuffer, *positionBuffer, *tupleBuffer;
 
+        std::unordered_map<std::string, TableCatalog> catalogCache;        // table name to its cached catalog entries
+
+        std::unordered_map<std::string, TableHandle *> tableHandles;       // table name to its open handles
+        std::list<std::string> tableHandleLru;                              // tables with open handles, least recently used first
+        unsigned openDescriptors = 0;                                       // files held open by tableHandles
+
         static std::vector<Attribute> getTablesAttrs();
 
         static std::vector<Attribute> getColumnsAttrs();
@@ -62,6 +107,17 @@ namespace PeterDB {
 
         RC deleteFromSystemFiles(const std::string &tableName, const RID &rid);
 
+        void invalidateCatalog(const std::string &tableName);              // Forget the cached catalog entries of a table
+
+        RC openTable(const std::string &tableName, FileHandle *&fileHandle);   // Get the open handle of a table, holding it until released
+        void releaseTable(const std::string &tableName);                        // Give back a handle got from openTable
+        RC openIndex(const std::string &tableName, int columnPosition, IXFileHandle *&ixFileHandle);    // Get the open index handle of a held table
+        RC syncTable(const std::string &tableName);                             // Make the handles' writes visible to other handles on the files
+        RC closeIndex(const std::string &tableName, int columnPosition);        // Close the open handle of an index
+        RC closeTable(const std::string &tableName);                            // Close the open handles of a table and its indexes
+        RC closeTables();                                                       // Close every open handle
+        void evictTables();                                                     // Close least recently used handles over the descriptor cap
+
     public:
         static RelationManager &instance();
 
@@ -101,6 +157,11 @@ namespace PeterDB {
 
         RC insertTuple(const std::string &tableName, const void *data, RID &rid);
 
+        // Insert a batch of tuples, each in the insertTuple format, putting their rids in the same order.
+        // Index entries are added per index in key order once the records are stored.
+        // On failure rids holds the tuples stored before it, all of them indexed, and the first error is returned.
+        RC insertTuples(const std::string &tableName, const std::vector<const void *> &batch, std::vector<RID> &rids);
+
         RC deleteTuple(const std::string &tableName, const RID &rid);
 
         RC updateTuple(const std::string &tableName, const void *data, const RID &rid);
@@ -122,6 +183,25 @@ namespace PeterDB {
                 const std::vector<std::string> &attributeNames, // a list of projected attributes
                 RM_ScanIterator &rm_ScanIterator);
 
+        // Scan tuples satisfying every condition, evaluated against the stored records before projection.
+        RC scan(const std::string &tableName,
+                const std::vector<ScanCondition> &conditions,
+                const std::vector<std::string> &attributeNames,
+                RM_ScanIterator &rm_ScanIterator);
+
+        // Scan tuples satisfying any of the conjunctions.
+        RC scan(const std::string &tableName,
+                const std::vector<std::vector<ScanCondition>> &disjunction,
+                const std::vector<std::string> &attributeNames,
+                RM_ScanIterator &rm_ScanIterator);
+
+        // Scan tuples satisfying any of the conjunctions on numberOfWorkers threads.
+        RC parallelScan(const std::string &tableName,
+                        const std::vector<std::vector<ScanCondition>> &disjunction,
+                        const std::vector<std::string> &attributeNames,
+                        unsigned numberOfWorkers,
+                        RM_ParallelScanIterator &rm_ParallelScanIterator);
+
         void convert(const std::string &tableName, int fromVersion, int toVersion, const void *dataBuffer, int dataBufferLength, void* data);
 
         // Extra credit work (10 points)
@@ -142,6 +222,10 @@ namespace PeterDB {
 
         RC destroyIndex(const std::string &tableName, const std::string &attributeName);
 
+        // Rebuild the index on an attribute with its leaves filled up to fillFactor, shrinking its file.
+        // Index scans open on it have to be started again afterwards.
+        RC compactIndex(const std::string &tableName, const std::string &attributeName, float fillFactor = 1.0f);
+
         // indexScan returns an iterator to allow the caller to go through qualified entries in index
         RC indexScan(const std::string &tableName,
                      const std::string &attributeName,
@@ -1,5 +1,7 @@
 #include "src/include/ix.h"
 
+#include <algorithm>
+
 namespace PeterDB {
     IndexManager &IndexManager::instance() {
         static IndexManager _index_manager = IndexManager();
@@ -10,7 +12,7 @@ namespace PeterDB {
         return PagedFileManager::instance().createFile(fileName);
     }
 
-    bool IndexManager::isLeaf(char *pageBuffer) {
+    bool IndexManager::isLeaf(const char *pageBuffer) {
         return pageBuffer[0] >> 7 & (unsigned) 1;
     }
 
@@ -18,11 +20,15 @@ namespace PeterDB {
         return PagedFileManager::instance().destroyFile(fileName);
     }
 
-    RC IndexManager::openFile(const std::string &fileName, IXFileHandle &ixFileHandle) {
-        return PagedFileManager::instance().openFile(fileName, ixFileHandle.fileHandle);
+    RC IndexManager::openFile(const std::string &fileName, IXFileHandle &ixFileHandle, bool mapped) {
+        ixFileHandle.cachedNodes.clear();
+        ixFileHandle.pointerRead = false;
+        return PagedFileManager::instance().openFile(fileName, ixFileHandle.fileHandle, mapped);
     }
 
     RC IndexManager::closeFile(IXFileHandle &ixFileHandle) {
+        ixFileHandle.cachedNodes.clear();
+        ixFileHandle.pointerRead = false;
         return PagedFileManager::instance().closeFile(ixFileHandle.fileHandle);
     }
 
@@ -31,18 +37,71 @@ namespace PeterDB {
         std::memset(pointerBuffer, 0, PAGE_SIZE);
         std::memcpy(pointerBuffer, &ixFileHandle.rootPageNum, sizeof(PageNum));
         std::memcpy(pointerBuffer + sizeof(PageNum), &ixFileHandle.keyType, sizeof(unsigned));
-        return ixFileHandle.fileHandle.writePage(0, pointerBuffer);
+        std::memcpy(pointerBuffer + sizeof(PageNum) + sizeof(unsigned), &ixFileHandle.treeVersion, sizeof(unsigned));
+        RC rc = ixFileHandle.fileHandle.writePage(0, pointerBuffer);
+        if (rc != 0) return rc;
+        ixFileHandle.pointerVersion = ixFileHandle.fileHandle.getWriteVersion();
+        ixFileHandle.pointerWrites = ixFileHandle.fileHandle.writeCalls;
+        return 0;
     }
 
+    // Each page write bumps both the write version of the file and the write calls of the handle making it, so when
+    // they moved by the same amount no other handle can have changed the pointer page
     RC IndexManager::readRootPageNum(IXFileHandle &ixFileHandle) {
+        unsigned writeVersion = ixFileHandle.fileHandle.getWriteVersion();
+        unsigned writes = ixFileHandle.fileHandle.writeCalls;
+        if (ixFileHandle.pointerRead &&
+            writeVersion - ixFileHandle.pointerVersion == writes - ixFileHandle.pointerWrites) return 0;
         char pointerBuffer[PAGE_SIZE];
         RC rc = ixFileHandle.fileHandle.readPage(0, pointerBuffer);
         if (rc != 0) return rc;
-        std::memcpy(&ixFileHandle.rootPageNum, pointerBuffer, sizeof(PageNum));
+        PageNum rootPageNum;
+        unsigned treeVersion;
+        std::memcpy(&rootPageNum, pointerBuffer, sizeof(PageNum));
         std::memcpy(&ixFileHandle.keyType, pointerBuffer + sizeof(PageNum), sizeof(unsigned));
+        std::memcpy(&treeVersion, pointerBuffer + sizeof(PageNum) + sizeof(unsigned), sizeof(unsigned));
+        if (rootPageNum != ixFileHandle.rootPageNum || treeVersion != ixFileHandle.treeVersion) ixFileHandle.cachedNodes.clear();
+        ixFileHandle.rootPageNum = rootPageNum;
+        ixFileHandle.treeVersion = treeVersion;
+        ixFileHandle.pointerRead = true;
+        ixFileHandle.pointerVersion = writeVersion;
+        ixFileHandle.pointerWrites = writes;
+        return 0;
+    }
+
+    // Leaves change on every insertion and deletion, so only inner nodes are worth keeping
+    RC IndexManager::readNode(IXFileHandle &ixFileHandle, PageNum pageNum, char *pageBuffer, const PageIndex **keyOffsets) {
+        if (keyOffsets != nullptr) *keyOffsets = nullptr;
+        auto cachedNode = ixFileHandle.cachedNodes.find(pageNum);
+        if (cachedNode == ixFileHandle.cachedNodes.end()) {
+            RC rc = ixFileHandle.fileHandle.readPage(pageNum, pageBuffer);
+            if (rc != 0) return rc;
+            if (isLeaf(pageBuffer) || ixFileHandle.cachedNodes.size() >= NODE_CACHE_SIZE) return 0;
+            cachedNode = ixFileHandle.cachedNodes.emplace(pageNum, CachedNode()).first;
+            cacheNode(ixFileHandle, cachedNode->second, pageBuffer);
+        } else {
+            std::memcpy(pageBuffer, cachedNode->second.page.data(), PAGE_SIZE);
+        }
+        if (keyOffsets != nullptr && !cachedNode->second.keyOffsets.empty()) *keyOffsets = cachedNode->second.keyOffsets.data();
         return 0;
     }
 
+    // The offsets are gathered once when the node is cached, instead of on every lookup through it
+    void IndexManager::cacheNode(IXFileHandle &ixFileHandle, CachedNode &cachedNode, const char *pageBuffer) {
+        cachedNode.page.assign(pageBuffer, pageBuffer + PAGE_SIZE);
+        cachedNode.keyOffsets.clear();
+        if (ixFileHandle.keyType != 2) return;
+        PageIndex keyListSize = getKeyListSize(pageBuffer);
+        cachedNode.keyOffsets.resize(keyListSize + 1);
+        getKeyOffsets(pageBuffer, 1 + sizeof(PageIndex) + (keyListSize + 1) * sizeof(PageNum), keyListSize, ixFileHandle.keyType,
+                      cachedNode.keyOffsets.data());
+    }
+
+    RC IndexManager::writeNewPage(IXFileHandle &ixFileHandle, PageNum pageNum, const void *data) {
+        if (pageNum == ixFileHandle.fileHandle.numberOfPages) return ixFileHandle.fileHandle.appendPage(data);
+        return ixFileHandle.fileHandle.writePage(pageNum, data);
+    }
+
     RC IndexManager::createNode(char *nodeBuffer) {
         std::memset(nodeBuffer, 0, PAGE_SIZE);
         PageIndex startOfFreeSpace = 1 + sizeof(PageIndex);
@@ -137,17 +196,43 @@ namespace PeterDB {
         return compareRID(ridBuffer, rid);
     }
 
+    // VarChar keys need a walk over their lengths
+    void IndexManager::getKeyOffsets(const char *pageBuffer, PageIndex firstKeyOffset, PageIndex keyListSize, unsigned keyType, PageIndex *keyOffsets) {
+        PageIndex offset = firstKeyOffset;
+        for (PageIndex index = 0; index < keyListSize; index++) {
+            keyOffsets[index] = offset;
+            offset = offset + getCompKeyLength(pageBuffer + offset, keyType);
+        }
+        keyOffsets[keyListSize] = offset;
+    }
+
+    PageIndex IndexManager::getKeyOffset(PageIndex firstKeyOffset, const PageIndex *keyOffsets, PageIndex index, unsigned keyType) {
+        if (keyType != 2) return firstKeyOffset + index * (sizeof(int) + RID_SIZE);
+        return keyOffsets[index];
+    }
+
+    PageIndex IndexManager::getKeyOffset(const char *pageBuffer, PageIndex firstKeyOffset, PageIndex index, unsigned keyType) {
+        if (keyType != 2) return firstKeyOffset + index * (sizeof(int) + RID_SIZE);
+        PageIndex offset = firstKeyOffset;
+        for (PageIndex position = 0; position < index; position++) offset = offset + getCompKeyLength(pageBuffer + offset, keyType);
+        return offset;
+    }
+
+    // Binary search the first composite key not less than the one given, its offset is negated if it is equal.
+    // Fixed-length keys are probed in place, only VarChar keys have their offsets gathered first
     int IndexManager::findInLeaf(const char *leafBuffer, const void *key, const RID &rid, unsigned keyType, PageIndex &index) {
-        index = 0;
-        PageIndex keyListLength = getKeyListSize(leafBuffer);
-        int offset = 1 + sizeof(PageIndex);
-        while (index < keyListLength) {
-            int cmp = compareCompKey(leafBuffer + offset, key, rid, keyType);
-            if (cmp == 0) return -offset;
-            if (cmp > 0) break;
-            offset = offset + getCompKeyLength(leafBuffer + offset, keyType);
-            index = index + 1;
+        PageIndex keyListLength = getKeyListSize(leafBuffer), firstKeyOffset = 1 + sizeof(PageIndex);
+        PageIndex keyOffsets[keyType == 2 ? keyListLength + 1 : 1];
+        if (keyType == 2) getKeyOffsets(leafBuffer, firstKeyOffset, keyListLength, keyType, keyOffsets);
+        PageIndex low = 0, high = keyListLength;
+        while (low < high) {
+            PageIndex mid = (low + high) / 2;
+            if (compareCompKey(leafBuffer + getKeyOffset(firstKeyOffset, keyOffsets, mid, keyType), key, rid, keyType) < 0) low = mid + 1;
+            else high = mid;
         }
+        index = low;
+        PageIndex offset = getKeyOffset(firstKeyOffset, keyOffsets, low, keyType);
+        if (low < keyListLength && compareCompKey(leafBuffer + offset, key, rid, keyType) == 0) return -offset;
         return offset;
     }
 
@@ -255,19 +340,20 @@ namespace PeterDB {
         ixFileHandle.rootPageNum = ixFileHandle.fileHandle.numberOfPages;
         RC rc = writeRootPageNum(ixFileHandle);
         if (rc != 0) return rc;
-        return ixFileHandle.fileHandle.appendPage(newRootBuffer);
+        return writeNewPage(ixFileHandle, ixFileHandle.rootPageNum, newRootBuffer);
     }
 
     RC IndexManager::insert(IXFileHandle &ixFileHandle, PageNum nodeNum, const void *key, const RID &rid,
                             Entry &childEntry, unsigned keyType) {
         RC rc;
         char pageBuffer[PAGE_SIZE];
-        rc = ixFileHandle.fileHandle.readPage(nodeNum, pageBuffer);
+        const PageIndex *keyOffsets;
+        rc = readNode(ixFileHandle, nodeNum, pageBuffer, &keyOffsets);
         if (rc != 0) return rc;
 
         if (!isLeaf(pageBuffer)) {
             int pageNumOffset, keyOffset;
-            PageNum pageNum = findInNode(pageBuffer, key, keyType, pageNumOffset, keyOffset, rid);
+            PageNum pageNum = findInNode(pageBuffer, key, keyType, pageNumOffset, keyOffset, rid, keyOffsets);
             rc = insert(ixFileHandle, pageNum, key, rid, childEntry, keyType);
             if (rc != 0) return rc;
             if (childEntry.isNull) return 0;
@@ -309,7 +395,7 @@ namespace PeterDB {
                 else insertNode(newNodeBuffer, pageNumOffset - (oldListSize + 1) * sizeof(PageNum), 1 + sizeof(PageIndex) + keyOffset - midKeyOffset - midKeyLength - RID_SIZE + (newListSize + 1) * sizeof(PageNum), childEntryCopy);
                 delete[] childEntryCopy.key;
 
-                rc = ixFileHandle.fileHandle.appendPage(newNodeBuffer);
+                rc = writeNewPage(ixFileHandle, childEntry.nodeNum, newNodeBuffer);
                 if (rc != 0) return rc;
 
                 if (nodeNum == ixFileHandle.rootPageNum) {
@@ -317,6 +403,8 @@ namespace PeterDB {
                     if (rc != 0) return rc;
                 }
             }
+            auto cachedNode = ixFileHandle.cachedNodes.find(nodeNum);
+            if (cachedNode != ixFileHandle.cachedNodes.end()) cacheNode(ixFileHandle, cachedNode->second, pageBuffer);
         } else {
             PageIndex index;
             int offset = findInLeaf(pageBuffer, key, rid, keyType, index);
@@ -358,7 +446,7 @@ namespace PeterDB {
                 childEntry.nodeNum = newPage;
                 getRID(newLeafBuffer + 1 + sizeof(PageIndex) + length, childEntry.rid);
 
-                rc = ixFileHandle.fileHandle.appendPage(newLeafBuffer);
+                rc = writeNewPage(ixFileHandle, newPage, newLeafBuffer);
                 if (rc != 0) return rc;
 
                 if (nodeNum == ixFileHandle.rootPageNum) {
@@ -380,6 +468,7 @@ namespace PeterDB {
             std::memset(pointerBuffer, 0, PAGE_SIZE);
             std::memcpy(pointerBuffer, &ixFileHandle.rootPageNum, sizeof(PageNum));
             std::memcpy(pointerBuffer + sizeof(PageNum), &ixFileHandle.keyType, sizeof(unsigned));
+            std::memcpy(pointerBuffer + sizeof(PageNum) + sizeof(unsigned), &ixFileHandle.treeVersion, sizeof(unsigned));
             rc = ixFileHandle.fileHandle.appendPage(pointerBuffer);
             if (rc != 0) return rc;
             char leafBuffer[PAGE_SIZE];
@@ -391,17 +480,22 @@ namespace PeterDB {
         readRootPageNum(ixFileHandle);
         if (attribute.type != ixFileHandle.keyType) return ERR_INDEX_UNMATCHED_TYPE;
         Entry childEntry;
+        PageNum numberOfPages = ixFileHandle.fileHandle.numberOfPages;
         rc =  insert(ixFileHandle, ixFileHandle.rootPageNum, key, rid, childEntry, attribute.type);
         delete[] childEntry.key;
-        return rc;
+        if (rc != 0) return rc;
+        if (ixFileHandle.fileHandle.numberOfPages == numberOfPages) return 0;
+        // A split changed inner nodes, other handles on the index have to drop their cached ones
+        ixFileHandle.treeVersion = ixFileHandle.treeVersion + 1;
+        return writeRootPageNum(ixFileHandle);
     }
 
     PageNum IndexManager::getLeftMostLeaf(IXFileHandle &ixFileHandle, char *leafBuffer) {
-        ixFileHandle.fileHandle.readPage(ixFileHandle.rootPageNum, leafBuffer);
+        readNode(ixFileHandle, ixFileHandle.rootPageNum, leafBuffer);
         PageNum leftMostLeaf = ixFileHandle.rootPageNum;
         while (!isLeaf(leafBuffer)) {
             std::memcpy(&leftMostLeaf, leafBuffer + 1 + sizeof(PageIndex), sizeof(PageNum));
-            ixFileHandle.fileHandle.readPage(leftMostLeaf, leafBuffer);
+            readNode(ixFileHandle, leftMostLeaf, leafBuffer);
         }
         return leftMostLeaf;
     }
@@ -409,13 +503,14 @@ namespace PeterDB {
     PageNum IndexManager::getLeafByKey(IXFileHandle &ixFileHandle, const void *key, unsigned keyType, char *leafBuffer, const RID &rid) {
         if (key == nullptr) return getLeftMostLeaf(ixFileHandle, leafBuffer);
 
-        ixFileHandle.fileHandle.readPage(ixFileHandle.rootPageNum, leafBuffer);
+        const PageIndex *keyOffsets;
+        readNode(ixFileHandle, ixFileHandle.rootPageNum, leafBuffer, &keyOffsets);
         PageNum pageNum = ixFileHandle.rootPageNum;
 
         int pageNumOffset, keyOffset;
         while (!isLeaf(leafBuffer)) {
-            pageNum = findInNode(leafBuffer, key, keyType, pageNumOffset, keyOffset, rid);
-            ixFileHandle.fileHandle.readPage(pageNum, leafBuffer);
+            pageNum = findInNode(leafBuffer, key, keyType, pageNumOffset, keyOffset, rid, keyOffsets);
+            readNode(ixFileHandle, pageNum, leafBuffer, &keyOffsets);
         }
 
         return pageNum;
@@ -441,6 +536,29 @@ namespace PeterDB {
         return ixFileHandle.fileHandle.writePage(leafPageNum, leafBuffer);
     }
 
+    // The entries are streamed in key order into a bulk loader, which holds them in memory or spills them to
+    // temporary files, so every index page can be written over
+    RC IndexManager::compactIndex(IXFileHandle &ixFileHandle, const Attribute &attribute, float fillFactor) {
+        if (ixFileHandle.fileHandle.numberOfPages == 0) return 0;
+        RC rc = readRootPageNum(ixFileHandle);
+        if (rc != 0) return rc;
+        if (attribute.type != ixFileHandle.keyType) return ERR_INDEX_UNMATCHED_TYPE;
+
+        IX_BulkLoader bulkLoader(ixFileHandle, attribute, fillFactor);
+        IX_ScanIterator ix_ScanIterator;
+        rc = scan(ixFileHandle, attribute, nullptr, nullptr, true, true, ix_ScanIterator);
+        if (rc != 0) return rc;
+        char key[PAGE_SIZE];
+        RID rid;
+        while ((rc = ix_ScanIterator.getNextEntry(rid, key)) == 0) {
+            rc = bulkLoader.addEntry(key, rid);
+            if (rc != 0) break;
+        }
+        ix_ScanIterator.close();
+        if (rc != IX_EOF) return rc;
+        return bulkLoader.rebuild();
+    }
+
     int IndexManager::printBTreeKey(const char *pageBuffer, std::ostream &out, unsigned int keyType) const {
         int length = 0;
         if (keyType == 2) std::memcpy(&length, pageBuffer, sizeof(int));
@@ -583,18 +701,30 @@ namespace PeterDB {
         return printBTreeNode(ixFileHandle, ixFileHandle.rootPageNum, out);
     }
 
-    PageNum IndexManager::findInNode(const char *nodeBuffer, const void *key, unsigned keyType, int &pageNumOffset, int &keyOffset, const RID &rid) {
-        int keyListSize = getKeyListSize(nodeBuffer);
+    // Binary search the child after the last composite key not greater than the one given.
+    // VarChar keys have their offsets gathered first unless the node cache already holds them
+    PageNum IndexManager::findInNode(const char *nodeBuffer, const void *key, unsigned keyType, int &pageNumOffset, int &keyOffset, const RID &rid,
+                                     const PageIndex *keyOffsets) {
+        PageIndex keyListSize = getKeyListSize(nodeBuffer);
         pageNumOffset = 1 + sizeof(PageIndex);
-        keyOffset = pageNumOffset + (keyListSize + 1) * sizeof(PageNum);
-        int keyIndex = 0, cmp;
-        while (keyIndex < keyListSize) {
-            cmp = compareCompKey(nodeBuffer + keyOffset, key, rid, keyType);
-            if (cmp > 0) break;
-            pageNumOffset = pageNumOffset + sizeof(PageNum);
-            if (cmp == 0) break;
-            keyOffset = keyOffset + getCompKeyLength(nodeBuffer + keyOffset, keyType);
-            keyIndex = keyIndex + 1;
+        PageIndex firstKeyOffset = pageNumOffset + (keyListSize + 1) * sizeof(PageNum);
+        bool gather = keyType == 2 && keyOffsets == nullptr;
+        PageIndex gatheredOffsets[gather ? keyListSize + 1 : 1];
+        if (gather) {
+            getKeyOffsets(nodeBuffer, firstKeyOffset, keyListSize, keyType, gatheredOffsets);
+            keyOffsets = gatheredOffsets;
+        }
+        PageIndex low = 0, high = keyListSize;
+        while (low < high) {
+            PageIndex mid = (low + high) / 2;
+            if (compareCompKey(nodeBuffer + getKeyOffset(firstKeyOffset, keyOffsets, mid, keyType), key, rid, keyType) <= 0) low = mid + 1;
+            else high = mid;
+        }
+        pageNumOffset = pageNumOffset + low * sizeof(PageNum);
+        keyOffset = getKeyOffset(firstKeyOffset, keyOffsets, low, keyType);
+        if (low > 0) {
+            PageIndex previousOffset = getKeyOffset(firstKeyOffset, keyOffsets, low - 1, keyType);
+            if (compareCompKey(nodeBuffer + previousOffset, key, rid, keyType) == 0) keyOffset = previousOffset;
         }
         PageNum pageNum;
         std::memcpy(&pageNum, nodeBuffer + pageNumOffset, sizeof(PageNum));
@@ -614,14 +744,30 @@ namespace PeterDB {
         ix_ScanIterator.init();
         ix_ScanIterator.ixFileHandle = &ixFileHandle;
         ix_ScanIterator.keyType = attribute.type;
+        ix_ScanIterator.leafNum = UNDEFINED_PAGE_NUM;
+        return ix_ScanIterator.seek(lowKey, highKey, lowKeyInclusive, highKeyInclusive);
+    }
+
+    IX_ScanIterator::IX_ScanIterator() {
+        init();
+    }
+
+    IX_ScanIterator::~IX_ScanIterator() {
+        close();
+    }
+
+    // A range starting inside the copied leaf is found there without a descent, which is the common case when
+    // neighbouring keys are looked up in order
+    RC IX_ScanIterator::seek(const void *lowKey, const void *highKey, bool lowKeyInclusive, bool highKeyInclusive) {
+        delete[] this->highKey;
+        this->highKey = nullptr;
         if (highKey) {
-            int highKeyLength = getKeyLength(highKey, attribute.type);
-            ix_ScanIterator.highKey = new char[highKeyLength];
-            std::memcpy(ix_ScanIterator.highKey, highKey, highKeyLength);
+            int highKeyLength = ix.getKeyLength(highKey, keyType);
+            this->highKey = new char[highKeyLength];
+            std::memcpy(this->highKey, highKey, highKeyLength);
         }
-        ix_ScanIterator.highKeyInclusive = highKeyInclusive;
+        this->highKeyInclusive = highKeyInclusive;
 
-        readRootPageNum(ixFileHandle);
         RID rid;
         if (lowKeyInclusive) {
             rid.pageNum = 0;
@@ -630,53 +776,101 @@ namespace PeterDB {
             rid.pageNum = UNDEFINED_PAGE_NUM;
             rid.slotNum = USHRT_MAX;
         }
-        char leafBuffer[PAGE_SIZE];
-        ix_ScanIterator.leafNum = getLeafByKey(ixFileHandle, lowKey, attribute.type, leafBuffer, rid);
-        PageIndex keyListSize = getKeyListSize(leafBuffer);
-        ix_ScanIterator.index = 0;
-        ix_ScanIterator.offset = 1 + sizeof(PageIndex);
+        unsigned version = ixFileHandle->fileHandle.getWriteVersion();
+        PageIndex keyListSize = leafNum == UNDEFINED_PAGE_NUM ? 0 : ix.getKeyListSize(leafBuffer);
+        bool inLeaf = false;
+        if (lowKey != nullptr && keyListSize > 0 && version == leafVersion) {
+            // Entries before the first one of the leaf are smaller still, so the range starts here if it
+            // starts after the first entry and not after the last one
+            PageIndex lastKeyOffset = ix.getKeyOffset(leafBuffer, 1 + sizeof(PageIndex), keyListSize - 1, keyType);
+            inLeaf = ix.compareCompKey(leafBuffer + 1 + sizeof(PageIndex), lowKey, rid, keyType) < 0 &&
+                     ix.compareCompKey(leafBuffer + lastKeyOffset, lowKey, rid, keyType) >= 0;
+        }
+        if (!inLeaf) {
+            ix.readRootPageNum(*ixFileHandle);
+            leafVersion = version;
+            leafNum = ix.getLeafByKey(*ixFileHandle, lowKey, keyType, leafBuffer, rid);
+        }
+        setPosition(0);
 
         if (lowKey == nullptr) return 0;
 
-        while (ix_ScanIterator.index < keyListSize) {
-            int cmp = compareCompKey(leafBuffer + ix_ScanIterator.offset, lowKey, rid, attribute.type);
-            if (cmp > 0 || lowKeyInclusive && cmp == 0) break;
-            ix_ScanIterator.offset = ix_ScanIterator.offset + getCompKeyLength(leafBuffer + ix_ScanIterator.offset, attribute.type);
-            ix_ScanIterator.index = ix_ScanIterator.index + 1;
-        }
+        PageIndex position;
+        if (ix.findInLeaf(leafBuffer, lowKey, rid, keyType, position) < 0 && !lowKeyInclusive) position = position + 1;
+        setPosition(position);
 
         return 0;
     }
 
-    IX_ScanIterator::IX_ScanIterator() {
-        init();
+    RC IX_ScanIterator::loadLeaf(PageNum pageNum) {
+        leafVersion = ixFileHandle->fileHandle.getWriteVersion();
+        RC rc = ixFileHandle->fileHandle.readPage(pageNum, leafBuffer);
+        if (rc != 0) return rc;
+        leafNum = pageNum;
+        setPosition(0);
+        return 0;
     }
 
-    IX_ScanIterator::~IX_ScanIterator() {
-        close();
+    // Entries may have been deleted or inserted around the position, or moved out by a split, so the position is
+    // found again by the entry last passed over. If that entry is gone, the scan goes on from the first one after it
+    RC IX_ScanIterator::refreshLeaf() {
+        unsigned version = ixFileHandle->fileHandle.getWriteVersion();
+        if (version == leafVersion) return 0;
+        char pageBuffer[PAGE_SIZE];
+        RC rc = ixFileHandle->fileHandle.readPage(leafNum, pageBuffer);
+        if (rc != 0) return rc;
+        leafVersion = version;
+        PageIndex position = 0;
+        if (index > 0) {
+            int lastKeyLength = ix.getKeyLength(leafBuffer + lastOffset, keyType);
+            RID lastRid;
+            ix.getRID(leafBuffer + lastOffset + lastKeyLength, lastRid);
+            if (ix.findInLeaf(pageBuffer, leafBuffer + lastOffset, lastRid, keyType, position) < 0) position = position + 1;
+        }
+        std::memcpy(leafBuffer, pageBuffer, PAGE_SIZE);
+        setPosition(position);
+        return 0;
     }
 
+    void IX_ScanIterator::setPosition(PageIndex position) {
+        index = position;
+        offset = 1 + sizeof(PageIndex);
+        if (position == 0) return;
+        lastOffset = ix.getKeyOffset(leafBuffer, offset, position - 1, keyType);
+        offset = lastOffset + ix.getCompKeyLength(leafBuffer + lastOffset, keyType);
+    }
+
+    // Entries come straight from the copied leaf, which is read again only after a write to the index
     RC IX_ScanIterator::getNextEntry(RID &rid, void *key) {
-        char leafBuffer[PAGE_SIZE];
-        ixFileHandle->fileHandle.readPage(leafNum, leafBuffer);
-        PageIndex keyListSize = ix.getKeyListSize(leafBuffer);
-        if (index < keyListSize && lastKeyLength != -1) {
-            int curKeyLength = ix.getKeyLength(leafBuffer + offset, keyType);
-            char curKey[curKeyLength];
-            std::memcpy(curKey, leafBuffer + offset, curKeyLength);
-            RID curRid;
-            ix.getRID(leafBuffer + offset + curKeyLength, curRid);
-            if (ix.compareKey(lastKey, curKey, keyType) == 0 && lastRid.pageNum == curRid.pageNum && lastRid.slotNum == curRid.slotNum) {
-                offset = offset + lastKeyLength + RID_SIZE;
-                index = index + 1;
-            }
+        RC rc = refreshLeaf();
+        if (rc != 0) return rc;
+        return nextEntry(rid, key);
+    }
+
+    // The index cannot change during the call, so the copied leaf is checked once for the whole batch
+    RC IX_ScanIterator::getNextEntries(std::vector<RID> &rids, void *keys, unsigned maxCount) {
+        rids.clear();
+        RC rc = refreshLeaf();
+        if (rc != 0) return rc;
+        char *key = (char *) keys;
+        RID rid;
+        while (rids.size() < maxCount) {
+            rc = nextEntry(rid, key);
+            if (rc != 0) break;
+            rids.push_back(rid);
+            if (key != nullptr) key = key + ix.getKeyLength(key, keyType);
         }
-        if (index >= keyListSize) {
-            leafNum = ix.getNextPageNum(leafBuffer);
-            if (leafNum == UNDEFINED_PAGE_NUM) return IX_EOF;
-            ixFileHandle->fileHandle.readPage(leafNum, leafBuffer);
-            index = 0;
-            offset = 1 + sizeof(PageIndex);
+        if (rc != 0 && rc != IX_EOF) return rc;
+        return rids.empty() ? IX_EOF : 0;
+    }
+
+    RC IX_ScanIterator::nextEntry(RID &rid, void *key) {
+        RC rc;
+        while (index >= ix.getKeyListSize(leafBuffer)) {
+            PageNum nextPageNum = ix.getNextPageNum(leafBuffer);
+            if (nextPageNum == UNDEFINED_PAGE_NUM) return IX_EOF;
+            rc = loadLeaf(nextPageNum);
+            if (rc != 0) return rc;
         }
         if (highKey) {
             if (highKeyInclusive) {
@@ -689,31 +883,26 @@ namespace PeterDB {
                 if (cmp >= 0) return IX_EOF;
             }
         }
-        lastKeyLength = ix.getKeyLength(leafBuffer + offset, keyType);
-        delete[] lastKey;
-        lastKey = new char[lastKeyLength];
-        std::memcpy(key, leafBuffer + offset, lastKeyLength);
-        std::memcpy(lastKey, leafBuffer + offset, lastKeyLength);
-        ix.getRID(leafBuffer + offset + lastKeyLength, rid);
-        lastRid.pageNum = rid.pageNum;
-        lastRid.slotNum = rid.slotNum;
+        int keyLength = ix.getKeyLength(leafBuffer + offset, keyType);
+        if (key != nullptr) std::memcpy(key, leafBuffer + offset, keyLength);
+        ix.getRID(leafBuffer + offset + keyLength, rid);
+        lastOffset = offset;
+        offset = offset + keyLength + RID_SIZE;
+        index = index + 1;
         return 0;
     }
 
     RC IX_ScanIterator::init() {
         highKey = nullptr;
-        lastKeyLength = -1;
-        lastKey = nullptr;
-        lastRid.pageNum = UNDEFINED_PAGE_NUM;
-        lastRid.slotNum = USHRT_MAX;
+        if (leafBuffer == nullptr) leafBuffer = new char[PAGE_SIZE];
         return 0;
     }
 
     RC IX_ScanIterator::close() {
         delete[] highKey;
         highKey = nullptr;
-        delete[] lastKey;
-        lastKey = nullptr;
+        delete[] leafBuffer;
+        leafBuffer = nullptr;
         return 0;
     }
 
@@ -735,4 +924,329 @@ namespace PeterDB {
         return 0;
     }
 
+    IX_BulkLoader::IX_BulkLoader(IXFileHandle &ixFileHandle, const Attribute &attribute, float fillFactor)
+            : ixFileHandle(ixFileHandle), attribute(attribute), fillFactor(fillFactor) {
+        if (this->fillFactor <= 0 || this->fillFactor > 1) this->fillFactor = 1;
+        leafBuffer = new char[PAGE_SIZE];
+        runDescriptor.push_back(attribute);
+        runDescriptor.push_back({"pageNum", TypeInt, sizeof(int)});
+        runDescriptor.push_back({"slotNum", TypeInt, sizeof(int)});
+    }
+
+    IX_BulkLoader::~IX_BulkLoader() {
+        for (RBFM_ScanIterator *runScan : runScans) {
+            runScan->close();
+            delete runScan;
+        }
+        for (const auto &fileName : runFileNames) {
+            if (!fileName.empty()) rbfm.destroyFile(fileName);
+        }
+        delete[] leafBuffer;
+    }
+
+    int IX_BulkLoader::compareEntries(const char *entry, const char *other) {
+        int cmp = ix.compareKey(entry, other, attribute.type);
+        if (cmp != 0) return cmp;
+        RID rid, otherRid;
+        ix.getRID(entry + ix.getKeyLength(entry, attribute.type), rid);
+        ix.getRID(other + ix.getKeyLength(other, attribute.type), otherRid);
+        return ix.compareRID(rid, otherRid);
+    }
+
+    RC IX_BulkLoader::addEntry(const void *key, const RID &rid) {
+        PageIndex keyLength = ix.getKeyLength(key, attribute.type);
+        entryOffsets.push_back(entryBuffer.size());
+        entryBuffer.insert(entryBuffer.end(), (const char *) key, (const char *) key + keyLength);
+        entryBuffer.insert(entryBuffer.end(), (const char *) &rid.pageNum, (const char *) &rid.pageNum + sizeof(PageNum));
+        entryBuffer.insert(entryBuffer.end(), (const char *) &rid.slotNum, (const char *) &rid.slotNum + sizeof(SlotNum));
+        if (entryBuffer.size() < BULK_LOAD_BUFFER_SIZE) return 0;
+        return spillRun();
+    }
+
+    void IX_BulkLoader::sortRun() {
+        const char *entries = entryBuffer.data();
+        std::sort(entryOffsets.begin(), entryOffsets.end(), [&](unsigned offset, unsigned other) {
+            return compareEntries(entries + offset, entries + other) < 0;
+        });
+    }
+
+    // A spilled entry is a record of its key, page num and slot num, none of them null
+    RC IX_BulkLoader::spillRun() {
+        sortRun();
+        std::string fileName;
+        // Without a free-space map records are appended, so the run scans back in the order it was written
+        RC rc = rbfm.createTempFile("bulkload", fileName);
+        if (rc != 0) return rc;
+        runFileNames.push_back(fileName);
+        FileHandle fileHandle;
+        rc = rbfm.openFile(fileName, fileHandle);
+        if (rc != 0) return rc;
+        for (unsigned index = 0; rc == 0 && index < entryOffsets.size(); index++) {
+            rc = writeRun(fileHandle, entryBuffer.data() + entryOffsets[index]);
+        }
+        if (rbfm.closeFile(fileHandle) != 0 && rc == 0) rc = ERR_FILE_CLOSE_FAILED;
+        entryBuffer.clear();
+        entryOffsets.clear();
+        return rc;
+    }
+
+    RC IX_BulkLoader::writeRun(FileHandle &fileHandle, const char *entry) {
+        char record[PAGE_SIZE];
+        record[0] = 0;
+        RID rid;
+        PageIndex keyLength = ix.getKeyLength(entry, attribute.type);
+        RID entryRid;
+        ix.getRID(entry + keyLength, entryRid);
+        int slotNum = entryRid.slotNum;
+        std::memcpy(record + 1, entry, keyLength);
+        std::memcpy(record + 1 + keyLength, &entryRid.pageNum, sizeof(PageNum));
+        std::memcpy(record + 1 + keyLength + sizeof(PageNum), &slotNum, sizeof(int));
+        return rbfm.insertRecord(fileHandle, runDescriptor, record, rid);
+    }
+
+    bool IX_BulkLoader::readRun(unsigned run, std::vector<char> &entry) {
+        char record[PAGE_SIZE];
+        RID rid;
+        if (runScans[run]->getNextRecord(rid, record) != 0) return false;
+        PageIndex keyLength = ix.getKeyLength(record + 1, attribute.type);
+        PageNum pageNum;
+        int slotNum;
+        std::memcpy(&pageNum, record + 1 + keyLength, sizeof(PageNum));
+        std::memcpy(&slotNum, record + 1 + keyLength + sizeof(PageNum), sizeof(int));
+        SlotNum entrySlotNum = slotNum;
+        entry.resize(keyLength + RID_SIZE);
+        std::memcpy(entry.data(), record + 1, keyLength);
+        std::memcpy(entry.data() + keyLength, &pageNum, sizeof(PageNum));
+        std::memcpy(entry.data() + keyLength + sizeof(PageNum), &entrySlotNum, sizeof(SlotNum));
+        return true;
+    }
+
+    RC IX_BulkLoader::openMerge(unsigned first, unsigned count) {
+        std::vector<std::string> attrNames;
+        for (const Attribute &attr : runDescriptor) attrNames.push_back(attr.name);
+        auto later = [&](unsigned run, unsigned other) {
+            return compareEntries(heads[run].data(), heads[other].data()) > 0;
+        };
+        heads.resize(count);
+        for (unsigned run = 0; run < count; run++) {
+            runScans.push_back(new RBFM_ScanIterator());
+            RC rc = rbfm.openFile(runFileNames[first + run], runScans[run]->fileHandle);
+            if (rc != 0) return rc;
+            rc = rbfm.scan(runScans[run]->fileHandle, runDescriptor, "", NO_OP, nullptr, attrNames, *runScans[run]);
+            if (rc != 0) return rc;
+            if (!readRun(run, heads[run])) continue;
+            mergeHeap.push_back(run);
+            std::push_heap(mergeHeap.begin(), mergeHeap.end(), later);
+        }
+        return 0;
+    }
+
+    bool IX_BulkLoader::nextMerged(std::vector<char> &entry) {
+        if (mergeHeap.empty()) return false;
+        auto later = [&](unsigned run, unsigned other) {
+            return compareEntries(heads[run].data(), heads[other].data()) > 0;
+        };
+        std::pop_heap(mergeHeap.begin(), mergeHeap.end(), later);
+        unsigned run = mergeHeap.back();
+        entry.swap(heads[run]);
+        if (readRun(run, heads[run])) std::push_heap(mergeHeap.begin(), mergeHeap.end(), later);
+        else mergeHeap.pop_back();
+        return true;
+    }
+
+    void IX_BulkLoader::closeMerge() {
+        for (RBFM_ScanIterator *runScan : runScans) {
+            runScan->close();
+            delete runScan;
+        }
+        runScans.clear();
+        heads.clear();
+        mergeHeap.clear();
+    }
+
+    RC IX_BulkLoader::finish() {
+        RC rc;
+        if (entryOffsets.empty() && runFileNames.empty()) return 0;
+
+        packing = ixFileHandle.fileHandle.numberOfPages == 0;
+        if (packing) {
+            // The pointer page comes first, the root it names is only known once every level is written
+            ixFileHandle.keyType = attribute.type;
+            char pointerBuffer[PAGE_SIZE];
+            std::memset(pointerBuffer, 0, PAGE_SIZE);
+            rc = ixFileHandle.fileHandle.appendPage(pointerBuffer);
+            if (rc != 0) return rc;
+            nextPageNum = 1;
+            ix.createLeaf(leafBuffer);
+        }
+
+        rc = loadEntries();
+        if (rc != 0) return rc;
+
+        if (!packing) return 0;
+        rc = writeLeaf(true);
+        if (rc != 0) return rc;
+        rc = writeNodes();
+        if (rc != 0) return rc;
+        return ix.writeRootPageNum(ixFileHandle);
+    }
+
+    // Every entry was read out of the index before, so its pages are written over from page 1 on. The root only
+    // changes once the pointer page is written, after which the pages left over at the end of the file are cut off
+    RC IX_BulkLoader::rebuild() {
+        RC rc;
+        packing = true;
+        nextPageNum = 1;
+        ix.createLeaf(leafBuffer);
+        ixFileHandle.cachedNodes.clear();
+
+        rc = loadEntries();
+        if (rc != 0) return rc;
+        if (children.empty()) children.emplace_back(nextPageNum, std::vector<char>());
+        rc = writeLeaf(true);
+        if (rc != 0) return rc;
+        rc = writeNodes();
+        if (rc != 0) return rc;
+
+        rc = ix.writeRootPageNum(ixFileHandle);
+        if (rc != 0) return rc;
+        return ixFileHandle.fileHandle.truncate(nextPageNum);
+    }
+
+    RC IX_BulkLoader::loadEntries() {
+        RC rc;
+        if (runFileNames.empty()) {
+            sortRun();
+            for (unsigned offset : entryOffsets) {
+                rc = load(entryBuffer.data() + offset);
+                if (rc != 0) return rc;
+            }
+        } else {
+            if (!entryOffsets.empty()) {
+                rc = spillRun();
+                if (rc != 0) return rc;
+            }
+            // Each pass merges groups of runs into one, so no more than BULK_LOAD_MERGE_FAN_IN run files are open
+            // at once. The runs of a finished group are destroyed right away, the destructor takes the rest
+            std::vector<char> entry;
+            while (runFileNames.size() > BULK_LOAD_MERGE_FAN_IN) {
+                std::vector<std::string> mergedFileNames;
+                for (unsigned first = 0; first < runFileNames.size(); first = first + BULK_LOAD_MERGE_FAN_IN) {
+                    unsigned count = std::min<unsigned>(BULK_LOAD_MERGE_FAN_IN, runFileNames.size() - first);
+                    if (count == 1) {
+                        mergedFileNames.push_back(runFileNames[first]);
+                        continue;
+                    }
+                    FileHandle fileHandle;
+                    std::string fileName;
+                    rc = rbfm.createTempFile("bulkload", fileName);
+                    if (rc == 0) {
+                        mergedFileNames.push_back(fileName);
+                        rc = rbfm.openFile(fileName, fileHandle);
+                    }
+                    if (rc == 0) rc = openMerge(first, count);
+                    while (rc == 0 && nextMerged(entry)) rc = writeRun(fileHandle, entry.data());
+                    closeMerge();
+                    if (fileHandle.pFile != nullptr && rbfm.closeFile(fileHandle) != 0 && rc == 0) rc = ERR_FILE_CLOSE_FAILED;
+                    if (rc != 0) {
+                        runFileNames.insert(runFileNames.end(), mergedFileNames.begin(), mergedFileNames.end());
+                        return rc;
+                    }
+                    for (unsigned run = first; run < first + count; run++) {
+                        rbfm.destroyFile(runFileNames[run]);
+                        runFileNames[run].clear();
+                    }
+                }
+                runFileNames = mergedFileNames;
+            }
+            rc = openMerge(0, runFileNames.size());
+            while (rc == 0 && nextMerged(entry)) rc = load(entry.data());
+            closeMerge();
+            if (rc != 0) return rc;
+        }
+        return 0;
+    }
+
+    RC IX_BulkLoader::writePage(const void *data) {
+        RC rc = ix.writeNewPage(ixFileHandle, nextPageNum, data);
+        if (rc != 0) return rc;
+        nextPageNum = nextPageNum + 1;
+        return 0;
+    }
+
+    RC IX_BulkLoader::load(const char *entry) {
+        RID rid;
+        PageIndex keyLength = ix.getKeyLength(entry, attribute.type);
+        ix.getRID(entry + keyLength, rid);
+        if (!packing) return ix.insertEntry(ixFileHandle, attribute, entry, rid);
+
+        PageIndex leafCapacity = (PageIndex) ((PAGE_SIZE - 1 - 2 * sizeof(PageIndex) - sizeof(PageNum)) * fillFactor);
+        PageIndex startOfFreeSpace = ix.getStartOfFreeSpace(leafBuffer);
+        if (ix.getKeyListSize(leafBuffer) > 0 &&
+            ((size_t) (startOfFreeSpace + keyLength + RID_SIZE) > 1 + sizeof(PageIndex) + leafCapacity || !ix.hasLeafSpace(leafBuffer, entry, attribute.type))) {
+            RC rc = writeLeaf(false);
+            if (rc != 0) return rc;
+            ix.createLeaf(leafBuffer);
+            startOfFreeSpace = ix.getStartOfFreeSpace(leafBuffer);
+        }
+        if (ix.getKeyListSize(leafBuffer) == 0) {
+            children.emplace_back(nextPageNum, std::vector<char>(entry, entry + keyLength + RID_SIZE));
+        }
+        ix.insertLeaf(leafBuffer, startOfFreeSpace, entry, rid, attribute.type);
+        return 0;
+    }
+
+    // Leaves are written one after another, so the next leaf is always the following page
+    RC IX_BulkLoader::writeLeaf(bool last) {
+        PageNum nextPage = last ? UNDEFINED_PAGE_NUM : nextPageNum + 1;
+        std::memcpy(leafBuffer + PAGE_SIZE - sizeof(PageIndex) - sizeof(PageNum), &nextPage, sizeof(PageNum));
+        return writePage(leafBuffer);
+    }
+
+    // A node takes as many children as fit, separated by the first composite keys of all but its first child
+    RC IX_BulkLoader::writeNodes() {
+        RC rc;
+        char nodeBuffer[PAGE_SIZE];
+        PageIndex nodeLimit = 1 + sizeof(PageIndex) + (PageIndex) ((PAGE_SIZE - 1 - 2 * sizeof(PageIndex)) * fillFactor);
+        while (children.size() > 1) {
+            std::vector<std::pair<PageNum, std::vector<char>>> parents;
+            unsigned first = 0;
+            while (first < children.size()) {
+                PageIndex size = 1 + sizeof(PageIndex) + sizeof(PageNum);
+                unsigned last = first + 1;
+                while (last < children.size()) {
+                    PageIndex childSize = sizeof(PageNum) + children[last].second.size();
+                    bool fits = size + childSize <= PAGE_SIZE - sizeof(PageIndex);
+                    // Every node gets two children, and a lone child left over joins the node before it
+                    if (!fits || (size + childSize > nodeLimit && last > first + 1 && last != children.size() - 1)) break;
+                    size = size + childSize;
+                    last = last + 1;
+                }
+
+                ix.createNode(nodeBuffer);
+                PageIndex keyListSize = last - first - 1;
+                std::memcpy(nodeBuffer + 1, &keyListSize, sizeof(PageIndex));
+                PageIndex pageNumOffset = 1 + sizeof(PageIndex);
+                PageIndex keyOffset = pageNumOffset + (keyListSize + 1) * sizeof(PageNum);
+                for (unsigned child = first; child < last; child++) {
+                    std::memcpy(nodeBuffer + pageNumOffset, &children[child].first, sizeof(PageNum));
+                    pageNumOffset = pageNumOffset + sizeof(PageNum);
+                    if (child == first) continue;
+                    std::memcpy(nodeBuffer + keyOffset, children[child].second.data(), children[child].second.size());
+                    keyOffset = keyOffset + children[child].second.size();
+                }
+                std::memcpy(nodeBuffer + PAGE_SIZE - sizeof(PageIndex), &keyOffset, sizeof(PageIndex));
+
+                parents.emplace_back(nextPageNum, children[first].second);
+                rc = writePage(nodeBuffer);
+                if (rc != 0) return rc;
+                first = last;
+            }
+            children.swap(parents);
+        }
+        ixFileHandle.rootPageNum = children[0].first;
+        ixFileHandle.treeVersion = ixFileHandle.treeVersion + 1;
+        return 0;
+    }
+
 } // namespace PeterDB
\ No newline at end of file
@@ -1,14 +1,24 @@
 #include "src/include/pfm.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+
 namespace PeterDB {
     PagedFileManager &PagedFileManager::instance() {
         static PagedFileManager _pf_manager = PagedFileManager();
         return _pf_manager;
     }
 
-    PagedFileManager::PagedFileManager() = default;
+    PagedFileManager::PagedFileManager() {
+        bufferPool = new BufferPool(BUFFER_POOL_SIZE);
+    }
 
-    PagedFileManager::~PagedFileManager() = default;
+    PagedFileManager::~PagedFileManager() {
+        delete bufferPool;
+    }
 
     PagedFileManager::PagedFileManager(const PagedFileManager &) = default;
 
@@ -21,14 +31,36 @@ namespace PeterDB {
         return true;
     }
 
-    RC PagedFileManager::createFile(const std::string &fileName) {
+    RC PagedFileManager::createFile(const std::string &fileName, bool freeSpaceMap) {
         if (exists(fileName)) return ERR_FILE_NAME_EXISTS;
         FILE *pFile = fopen(fileName.c_str(), "w+b");
         if (pFile == nullptr) return ERR_FILE_CREATE_FAILED;
+        return initFile(pFile, freeSpaceMap);
+    }
+
+    // mkstemp only ever creates a file that did not exist, so a temporary file can never take over another one
+    RC PagedFileManager::createTempFile(const std::string &prefix, std::string &fileName, bool freeSpaceMap) {
+        std::string nameTemplate = TEMP_FILE_PREFIX + prefix + "_XXXXXX";
+        std::vector<char> nameBuffer(nameTemplate.begin(), nameTemplate.end());
+        nameBuffer.push_back('\0');
+        int fd = mkstemp(nameBuffer.data());
+        if (fd < 0) return ERR_FILE_CREATE_FAILED;
+        fileName = nameBuffer.data();
+        FILE *pFile = fdopen(fd, "w+b");
+        if (pFile == nullptr) {
+            close(fd);
+            remove(fileName.c_str());
+            return ERR_FILE_CREATE_FAILED;
+        }
+        return initFile(pFile, freeSpaceMap);
+    }
+
+    RC PagedFileManager::initFile(FILE *pFile, bool freeSpaceMap) {
         void *pageBuffer = malloc(PAGE_SIZE);
         memset(pageBuffer, 0, PAGE_SIZE);
-        unsigned buffer[5] = {0};
-        std::memcpy(pageBuffer, buffer, sizeof(unsigned) * 5);
+        unsigned buffer[6] = {0};
+        if (freeSpaceMap) buffer[5] = FREE_SPACE_SPAN;
+        std::memcpy(pageBuffer, buffer, sizeof(unsigned) * 6);
         fwrite(pageBuffer, sizeof(char), PAGE_SIZE, pFile);
         free(pageBuffer);
         fclose(pFile);
@@ -37,29 +69,39 @@ namespace PeterDB {
 
     RC PagedFileManager::destroyFile(const std::string &fileName) {
         if (!exists(fileName)) return ERR_FILE_NOT_EXISTS;
+        if (bufferPool->isOpen(fileName)) return ERR_FILE_IN_USE;
         if (remove(fileName.c_str()) != 0) return ERR_FILE_DELETE_FAILED;
         else return 0;
     }
 
-    RC PagedFileManager::openFile(const std::string &fileName, FileHandle &fileHandle) {
+    RC PagedFileManager::openFile(const std::string &fileName, FileHandle &fileHandle, bool mapped) {
         if (fileHandle.pFile != nullptr) return ERR_FILE_HANDLE_REUSE;
         FILE *pFile = fopen(fileName.c_str(), "r+b");
         if (pFile == nullptr) return ERR_FILE_OPEN_FAILED;
         fseek(pFile, 0, SEEK_SET);
-        unsigned buffer[5];
-        if (fread(buffer, sizeof(unsigned), 5, pFile) == 5) {
+        unsigned buffer[6];
+        if (fread(buffer, sizeof(unsigned), 6, pFile) == 6) {
             fileHandle.pFile = pFile;
+            fileHandle.fileName = fileName;
+            fileHandle.fileId = bufferPool->registerFile(fileName);
+            fileHandle.poolWrites = bufferPool->getWriteCount(fileHandle.fileId);
             fileHandle.numberOfPages = buffer[0];
             fileHandle.readPageCounter = buffer[1];
             fileHandle.writePageCounter = buffer[2];
             fileHandle.appendPageCounter = buffer[3];
             fileHandle.version = buffer[4];
+            fileHandle.freeSpaceSpan = buffer[5];
             fileHandle.pageBuffer = malloc(PAGE_SIZE);
             fileHandle.recordBuffer = malloc(RECORD_SIZE);
             memset(fileHandle.pageBuffer, 0, PAGE_SIZE);
             memset(fileHandle.recordBuffer, 0, RECORD_SIZE);
             fileHandle.curPageNum = -1;
-            return 0;
+            fileHandle.writeBack = false;
+            if (!mapped) return 0;
+            // The mapping only sees what has reached the file
+            RC rc = bufferPool->flushPages(fileHandle.fileId);
+            if (rc != 0) return rc;
+            return fileHandle.mapFile();
         } else return ERR_FILE_WRONG_FORMAT;
     }
 
@@ -67,6 +109,10 @@ namespace PeterDB {
         return fileHandle.closeFile();
     }
 
+    BufferPool &PagedFileManager::getBufferPool() {
+        return *bufferPool;
+    }
+
     FileHandle::FileHandle() {
         numberOfPages = 0;
         readPageCounter = 0;
@@ -74,13 +120,17 @@ namespace PeterDB {
         appendPageCounter = 0;
     };
 
-    FileHandle::~FileHandle() = default;
+    FileHandle::~FileHandle() {
+        if (pFile != nullptr) PagedFileManager::instance().getBufferPool().flushFile(*this);
+    }
 
     RC FileHandle::closeFile() {
         if (pFile == nullptr) return 0;
-        fseek(pFile, 0, SEEK_SET);
-        unsigned buffer[5] = {numberOfPages, readPageCounter, writePageCounter, appendPageCounter, version};
-        fwrite(buffer, sizeof(unsigned), 5, pFile);
+        BufferPool &bufferPool = PagedFileManager::instance().getBufferPool();
+        RC rc = flush();
+        if (rc != 0) return rc;
+        bufferPool.unregisterFile(fileName, fileId);
+        unmapFile();
 
         free(pageBuffer);
         free(recordBuffer);
@@ -92,37 +142,460 @@ namespace PeterDB {
 
     RC FileHandle::readPage(PageNum pageNum, void *data) {
         if (pageNum >= numberOfPages) return ERR_PAGE_READ_EXCEED;
+        if (mappedData != nullptr) {
+            std::memcpy(data, getPagePointer(pageNum), PAGE_SIZE);
+            return 0;
+        }
+        PageNum filePageNum = getFilePageNum(pageNum);
+        BufferPool &bufferPool = PagedFileManager::instance().getBufferPool();
+        char *page = bufferPool.pinPage(*this, filePageNum, true, sequential);
+        if (page == nullptr) return readPageFromDisk(filePageNum, data);
+        std::memcpy(data, page, PAGE_SIZE);
+        return bufferPool.unpinPage(*this, filePageNum, false);
+    }
+
+    // In write-back mode the page only becomes dirty in the pool and reaches disk on eviction, flush or close.
+    // Otherwise write-through without allocation: a cached copy is refreshed, an uncached page stays on disk only
+    RC FileHandle::writePage(PageNum pageNum, const void *data) {
+        if (pageNum >= numberOfPages) return ERR_PAGE_WRITE_EXCEED;
+        PageNum filePageNum = getFilePageNum(pageNum);
+        BufferPool &bufferPool = PagedFileManager::instance().getBufferPool();
+        bufferPool.bumpWriteVersion(fileId);
+        writeCalls = writeCalls + 1;
+        char *page;
+        if (writeBack && mappedData == nullptr) {
+            page = bufferPool.pinPage(*this, filePageNum, false);
+            if (page != nullptr) {
+                std::memcpy(page, data, PAGE_SIZE);
+                return bufferPool.unpinPage(*this, filePageNum, true);
+            }
+        }
+        page = bufferPool.pinResidentPage(*this, filePageNum);
+        if (page != nullptr) {
+            std::memcpy(page, data, PAGE_SIZE);
+            bufferPool.unpinPage(*this, filePageNum, false);
+        }
+        return writePageToDisk(filePageNum, data);
+    }
+
+    // Every FREE_SPACE_SPAN data pages are preceded by the free-space page tracking them
+    PageNum FileHandle::getFilePageNum(PageNum pageNum) {
+        if (freeSpaceSpan == 0) return pageNum;
+        return pageNum + pageNum / freeSpaceSpan + 1;
+    }
+
+    unsigned FileHandle::getNumberOfFilePages() {
+        if (freeSpaceSpan == 0) return numberOfPages;
+        return numberOfPages + (numberOfPages + freeSpaceSpan - 1) / freeSpaceSpan;
+    }
+
+    RC FileHandle::readPageFromDisk(PageNum pageNum, void *data) {
         fseek(pFile, PAGE_SIZE * (pageNum + 1), SEEK_SET);
-        fread(data, sizeof(char), PAGE_SIZE, pFile);
+        if (fread(data, sizeof(char), PAGE_SIZE, pFile) != PAGE_SIZE) return ERR_PAGE_READ_EXCEED;
         readPageCounter = readPageCounter + 1;
         return 0;
     }
 
-    RC FileHandle::writePage(PageNum pageNum, const void *data) {
-        if (pageNum >= numberOfPages) return ERR_PAGE_WRITE_EXCEED;
+    RC FileHandle::writePageToDisk(PageNum pageNum, const void *data) {
         fseek(pFile, PAGE_SIZE * (pageNum + 1), SEEK_SET);
-        fwrite(data, sizeof(char), PAGE_SIZE, pFile);
+        if (fwrite(data, sizeof(char), PAGE_SIZE, pFile) != PAGE_SIZE) return ERR_PAGE_WRITE_EXCEED;
+        // The mapping shares the OS page cache, stdio buffering is all that may hide the write
+        if (mappedData != nullptr) fflush(pFile);
         writePageCounter = writePageCounter + 1;
         return 0;
     }
 
+    // Pages dirtied in write-back mode are counted when the pool writes them, not when they are dirtied
+    void FileHandle::collectPoolWrites() {
+        unsigned writes = PagedFileManager::instance().getBufferPool().getWriteCount(fileId);
+        writePageCounter = writePageCounter + (writes - poolWrites);
+        poolWrites = writes;
+    }
+
     RC FileHandle::appendPage(const void *data) {
-        fseek(pFile, PAGE_SIZE * (numberOfPages + 1), SEEK_SET);
+        if (freeSpaceSpan != 0 && numberOfPages % freeSpaceSpan == 0) {
+            char freeSpacePage[PAGE_SIZE];
+            std::memset(freeSpacePage, 0, PAGE_SIZE);
+            RC rc = writePageToDisk(getFilePageNum(numberOfPages) - 1, freeSpacePage);
+            if (rc != 0) return rc;
+        }
+        fseek(pFile, PAGE_SIZE * (getFilePageNum(numberOfPages) + 1), SEEK_SET);
         fwrite(data, sizeof(char), PAGE_SIZE, pFile);
         numberOfPages = numberOfPages + 1;
         appendPageCounter = appendPageCounter + 1;
+        fflush(pFile);
+        if (mappedData == nullptr) return 0;
+        RC rc = unmapFile();
+        if (rc != 0) return rc;
+        return mapFile();
+    }
+
+    // Write back the dirty pages of the file and the header, so other handles opened on the file see them.
+    // Another handle may have grown the file since this one read the header, so each field keeps the larger value.
+    // The page count of the header is only kept over this handle's if the file still holds that many pages,
+    // another handle may have truncated it
+    RC FileHandle::flush() {
+        if (pFile == nullptr) return 0;
+        RC rc = PagedFileManager::instance().getBufferPool().flushFile(*this);
+        if (rc != 0) return rc;
+        collectPoolWrites();
+        unsigned header[5] = {numberOfPages, readPageCounter, writePageCounter, appendPageCounter, version};
+        unsigned buffer[6] = {0};
+        fflush(pFile);
+        fseek(pFile, 0, SEEK_END);
+        long fileSize = ftell(pFile);
+        fseek(pFile, 0, SEEK_SET);
+        if (fread(buffer, sizeof(unsigned), 6, pFile) != 6) return ERR_FILE_WRONG_FORMAT;
+        unsigned filePages = buffer[0];
+        if (freeSpaceSpan != 0) filePages = filePages + (filePages + freeSpaceSpan - 1) / freeSpaceSpan;
+        if ((long) PAGE_SIZE * (filePages + 1) > fileSize) buffer[0] = numberOfPages;
+        for (unsigned i = 0; i < 5; i++) buffer[i] = std::max(buffer[i], header[i]);
+        fseek(pFile, 0, SEEK_SET);
+        fwrite(buffer, sizeof(unsigned), 6, pFile);
+        fflush(pFile);
+        return 0;
+    }
+
+    // Cached copies of the dropped pages are forgotten first, so writing one back cannot grow the file again
+    RC FileHandle::truncate(unsigned numberOfPages) {
+        if (pFile == nullptr || numberOfPages >= this->numberOfPages) return 0;
+        BufferPool &bufferPool = PagedFileManager::instance().getBufferPool();
+        RC rc = bufferPool.flushFile(*this);
+        if (rc != 0) return rc;
+        bool mapped = mappedData != nullptr;
+        rc = unmapFile();
+        if (rc != 0) return rc;
+        this->numberOfPages = numberOfPages;
+        bufferPool.dropPages(fileId, getNumberOfFilePages());
+        curPageNum = -1;
+        fflush(pFile);
+        if (ftruncate(fileno(pFile), (off_t) PAGE_SIZE * (getNumberOfFilePages() + 1)) != 0) return ERR_FILE_TRUNCATE_FAILED;
+        rc = flush();
+        if (rc != 0) return rc;
+        if (mapped) return mapFile();
+        return 0;
+    }
+
+    RC FileHandle::mapFile() {
+        if (pFile == nullptr) return ERR_FILE_MAP_FAILED;
+        if (mappedData != nullptr) return 0;
+        size_t size = (size_t) PAGE_SIZE * (getNumberOfFilePages() + 1);
+        void *address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileno(pFile), 0);
+        if (address == MAP_FAILED) return ERR_FILE_MAP_FAILED;
+        mappedData = (char *) address;
+        mappedSize = size;
+        return 0;
+    }
+
+    RC FileHandle::unmapFile() {
+        if (mappedData == nullptr) return 0;
+        if (munmap(mappedData, mappedSize) != 0) return ERR_FILE_UNMAP_FAILED;
+        mappedData = nullptr;
+        mappedSize = 0;
         return 0;
     }
 
+    bool FileHandle::isMapped() {
+        return mappedData != nullptr;
+    }
+
+    const char *FileHandle::getPagePointer(PageNum pageNum) {
+        if (mappedData == nullptr || pageNum >= numberOfPages) return nullptr;
+        return mappedData + (size_t) PAGE_SIZE * (getFilePageNum(pageNum) + 1);
+    }
+
+    unsigned FileHandle::getWriteVersion() {
+        return PagedFileManager::instance().getBufferPool().getWriteVersion(fileId);
+    }
+
+    bool FileHandle::hasFreeSpaceMap() {
+        return freeSpaceSpan != 0;
+    }
+
+    // A free-space page is a max-tree of one-byte buckets: node i has children 2i and 2i + 1,
+    // the leaf of the k-th tracked data page sits at FREE_SPACE_SPAN + k
+    RC FileHandle::setPageFreeSpace(PageNum pageNum, unsigned short freeSpace) {
+        if (freeSpaceSpan == 0) return 0;
+        if (pageNum >= numberOfPages) return ERR_PAGE_WRITE_EXCEED;
+        unsigned bucket = freeSpace / FREE_SPACE_UNIT;
+        if (bucket > UCHAR_MAX) bucket = UCHAR_MAX;
+
+        PageNum filePageNum = getFilePageNum(pageNum - pageNum % freeSpaceSpan) - 1;
+        BufferPool &bufferPool = PagedFileManager::instance().getBufferPool();
+        char pageBuffer[PAGE_SIZE];
+        unsigned char *tree = (unsigned char *) bufferPool.pinPage(*this, filePageNum, true);
+        bool pinned = tree != nullptr;
+        if (!pinned) {
+            RC rc = readPageFromDisk(filePageNum, pageBuffer);
+            if (rc != 0) return rc;
+            tree = (unsigned char *) pageBuffer;
+        }
+
+        unsigned index = freeSpaceSpan + pageNum % freeSpaceSpan;
+        bool changed = tree[index] != bucket;
+        tree[index] = bucket;
+        while (changed && index > 1) {
+            index = index / 2;
+            unsigned char max = std::max(tree[2 * index], tree[2 * index + 1]);
+            changed = tree[index] != max;
+            tree[index] = max;
+        }
+
+        if (!pinned) return writePageToDisk(filePageNum, pageBuffer);
+        if (writeBack) return bufferPool.unpinPage(*this, filePageNum, true);
+        RC rc = writePageToDisk(filePageNum, tree);
+        bufferPool.unpinPage(*this, filePageNum, false);
+        return rc;
+    }
+
+    PageNum FileHandle::findPageWithFreeSpace(unsigned short freeSpace) {
+        if (freeSpaceSpan == 0) return numberOfPages;
+        unsigned bucket = (freeSpace + FREE_SPACE_UNIT - 1) / FREE_SPACE_UNIT;
+        if (bucket > UCHAR_MAX) return numberOfPages;
+
+        BufferPool &bufferPool = PagedFileManager::instance().getBufferPool();
+        char pageBuffer[PAGE_SIZE];
+        for (PageNum firstPageNum = 0; firstPageNum < numberOfPages; firstPageNum = firstPageNum + freeSpaceSpan) {
+            PageNum filePageNum = getFilePageNum(firstPageNum) - 1;
+            const unsigned char *tree = (const unsigned char *) bufferPool.pinPage(*this, filePageNum, true);
+            bool pinned = tree != nullptr;
+            if (!pinned) {
+                if (readPageFromDisk(filePageNum, pageBuffer) != 0) return numberOfPages;
+                tree = (const unsigned char *) pageBuffer;
+            }
+            unsigned index = 1;
+            if (tree[index] >= bucket) {
+                while (index < freeSpaceSpan) index = tree[2 * index] >= bucket ? 2 * index : 2 * index + 1;
+            }
+            if (pinned) bufferPool.unpinPage(*this, filePageNum, false);
+            if (index >= freeSpaceSpan) return firstPageNum + index - freeSpaceSpan;
+        }
+        return numberOfPages;
+    }
+
     unsigned FileHandle::getNumberOfPages() {
         return numberOfPages;
     }
 
     RC FileHandle::collectCounterValues(unsigned &readPageCount, unsigned &writePageCount, unsigned &appendPageCount) {
+        if (pFile != nullptr) collectPoolWrites();
         readPageCount = readPageCounter;
         writePageCount = writePageCounter;
         appendPageCount = appendPageCounter;
         return 0;
     }
 
+    BufferPool::BufferPool(unsigned numberOfFrames) {
+        hitCounter = 0;
+        missCounter = 0;
+        nextFileId = 0;
+        setNumberOfFrames(numberOfFrames);
+    }
+
+    BufferPool::~BufferPool() {
+        for (Frame &frame : frames) {
+            if (frame.valid) flushFrame(frame);
+            free(frame.data);
+        }
+        for (auto &stream : streams) fclose(stream.second);
+    }
+
+    unsigned long long BufferPool::getPageKey(unsigned fileId, PageNum pageNum) {
+        return (unsigned long long) fileId << 32u | pageNum;
+    }
+
+    // The pool writes dirty pages back through a stream of its own, so it never depends on the handle that dirtied them
+    unsigned BufferPool::registerFile(const std::string &fileName) {
+        auto it = files.find(fileName);
+        if (it == files.end()) {
+            it = files.emplace(fileName, std::make_pair(nextFileId++, 0)).first;
+            FILE *pFile = fopen(fileName.c_str(), "r+b");
+            if (pFile != nullptr) streams[it->second.first] = pFile;
+        }
+        it->second.second = it->second.second + 1;
+        return it->second.first;
+    }
+
+    void BufferPool::unregisterFile(const std::string &fileName, unsigned fileId) {
+        auto it = files.find(fileName);
+        if (it == files.end() || it->second.first != fileId) return;
+        it->second.second = it->second.second - 1;
+        if (it->second.second > 0) return;
+        flushPages(fileId);
+        dropFileId(fileId);
+        writeVersions.erase(fileId);
+        writeCounts.erase(fileId);
+        files.erase(it);
+    }
+
+    bool BufferPool::isOpen(const std::string &fileName) {
+        return files.find(fileName) != files.end();
+    }
+
+    void BufferPool::dropPages(unsigned fileId, PageNum firstPageNum) {
+        for (unsigned frameIndex = 0; frameIndex < frames.size(); frameIndex++) {
+            const Frame &frame = frames[frameIndex];
+            if (frame.valid && frame.fileId == fileId && frame.pageNum >= firstPageNum) releaseFrame(frameIndex);
+        }
+    }
+
+    void BufferPool::dropFileId(unsigned fileId) {
+        for (unsigned frameIndex = 0; frameIndex < frames.size(); frameIndex++) {
+            if (frames[frameIndex].valid && frames[frameIndex].fileId == fileId) releaseFrame(frameIndex);
+        }
+        auto it = streams.find(fileId);
+        if (it == streams.end()) return;
+        fclose(it->second);
+        streams.erase(it);
+    }
+
+    void BufferPool::releaseFrame(unsigned frameIndex) {
+        Frame &frame = frames[frameIndex];
+        pageTable.erase(getPageKey(frame.fileId, frame.pageNum));
+        if (frame.pinCount == 0) lruList.erase(frame.lruPos);
+        frame.valid = false;
+        frame.dirty = false;
+        frame.useOnce = false;
+        frame.pinCount = 0;
+        freeFrames.push_back(frameIndex);
+    }
+
+    // Handles read through their own streams, so the page is pushed past stdio buffering right away
+    RC BufferPool::flushFrame(Frame &frame) {
+        if (!frame.dirty) return 0;
+        auto it = streams.find(frame.fileId);
+        if (it == streams.end()) return ERR_FILE_OPEN_FAILED;
+        fseek(it->second, PAGE_SIZE * (frame.pageNum + 1), SEEK_SET);
+        if (fwrite(frame.data, sizeof(char), PAGE_SIZE, it->second) != PAGE_SIZE) return ERR_PAGE_WRITE_EXCEED;
+        fflush(it->second);
+        frame.dirty = false;
+        writeCounts[frame.fileId] = writeCounts[frame.fileId] + 1;
+        return 0;
+    }
+
+    // A page whose file has no stream can never be written back and is dropped. One whose write failed stays
+    // dirty for a later flush to retry and the next unpinned frame is tried instead
+    int BufferPool::getVictimFrame() {
+        auto lruPos = lruList.begin();
+        while (freeFrames.empty() && lruPos != lruList.end()) {
+            unsigned frameIndex = *lruPos++;
+            Frame &frame = frames[frameIndex];
+            if (flushFrame(frame) != 0 && streams.find(frame.fileId) != streams.end()) continue;
+            releaseFrame(frameIndex);
+        }
+        if (freeFrames.empty()) return -1;
+        unsigned frameIndex = freeFrames.back();
+        freeFrames.pop_back();
+        return frameIndex;
+    }
+
+    char *BufferPool::pinResidentPage(FileHandle &fileHandle, PageNum pageNum) {
+        auto it = pageTable.find(getPageKey(fileHandle.fileId, pageNum));
+        if (it == pageTable.end()) return nullptr;
+        Frame &frame = frames[it->second];
+        if (frame.pinCount == 0) lruList.erase(frame.lruPos);
+        frame.pinCount = frame.pinCount + 1;
+        return frame.data;
+    }
+
+    // A page a scan finds already cached keeps its place; one it loads is evicted first once released
+    char *BufferPool::pinPage(FileHandle &fileHandle, PageNum pageNum, bool load, bool useOnce) {
+        char *page = pinResidentPage(fileHandle, pageNum);
+        if (page != nullptr) {
+            hitCounter = hitCounter + 1;
+            if (!useOnce) frames[pageTable[getPageKey(fileHandle.fileId, pageNum)]].useOnce = false;
+            return page;
+        }
+        missCounter = missCounter + 1;
+        int frameIndex = getVictimFrame();
+        if (frameIndex < 0) return nullptr;
+        Frame &frame = frames[frameIndex];
+        if (load && fileHandle.readPageFromDisk(pageNum, frame.data) != 0) {
+            freeFrames.push_back(frameIndex);
+            return nullptr;
+        }
+        frame.fileId = fileHandle.fileId;
+        frame.pageNum = pageNum;
+        frame.valid = true;
+        frame.dirty = false;
+        frame.useOnce = useOnce;
+        frame.pinCount = 1;
+        pageTable[getPageKey(frame.fileId, pageNum)] = frameIndex;
+        return frame.data;
+    }
+
+    RC BufferPool::unpinPage(FileHandle &fileHandle, PageNum pageNum, bool dirty) {
+        auto it = pageTable.find(getPageKey(fileHandle.fileId, pageNum));
+        if (it == pageTable.end()) return ERR_BUFFER_PAGE_NOT_PINNED;
+        Frame &frame = frames[it->second];
+        if (frame.pinCount == 0) return ERR_BUFFER_PAGE_NOT_PINNED;
+        if (dirty) frame.dirty = true;
+        frame.pinCount = frame.pinCount - 1;
+        if (frame.pinCount == 0) frame.lruPos = lruList.insert(frame.useOnce ? lruList.begin() : lruList.end(), it->second);
+        return 0;
+    }
+
+    RC BufferPool::flushFile(FileHandle &fileHandle) {
+        return flushPages(fileHandle.fileId);
+    }
+
+    RC BufferPool::flushPages(unsigned fileId) {
+        RC rc;
+        for (Frame &frame : frames) {
+            if (!frame.valid || !frame.dirty || frame.fileId != fileId) continue;
+            rc = flushFrame(frame);
+            if (rc != 0) return rc;
+        }
+        return 0;
+    }
+
+    // Lets a reader holding a copy of a page tell whether any handle on the file has written since it was taken
+    void BufferPool::bumpWriteVersion(unsigned fileId) {
+        writeVersions[fileId] = writeVersions[fileId] + 1;
+    }
+
+    unsigned BufferPool::getWriteVersion(unsigned fileId) {
+        auto it = writeVersions.find(fileId);
+        if (it == writeVersions.end()) return 0;
+        return it->second;
+    }
+
+    unsigned BufferPool::getWriteCount(unsigned fileId) {
+        auto it = writeCounts.find(fileId);
+        if (it == writeCounts.end()) return 0;
+        return it->second;
+    }
+
+    unsigned BufferPool::getNumberOfFrames() {
+        return frames.size();
+    }
+
+    RC BufferPool::setNumberOfFrames(unsigned numberOfFrames) {
+        RC rc;
+        for (Frame &frame : frames) {
+            if (frame.valid && frame.pinCount > 0) return ERR_BUFFER_PAGE_PINNED;
+        }
+        for (Frame &frame : frames) {
+            if (!frame.valid) continue;
+            rc = flushFrame(frame);
+            if (rc != 0) return rc;
+        }
+        for (Frame &frame : frames) free(frame.data);
+        frames = std::vector<Frame>(numberOfFrames);
+        lruList.clear();
+        pageTable.clear();
+        freeFrames.clear();
+        for (unsigned frameIndex = numberOfFrames; frameIndex > 0; frameIndex--) {
+            frames[frameIndex - 1].data = (char *) malloc(PAGE_SIZE);
+            freeFrames.push_back(frameIndex - 1);
+        }
+        return 0;
+    }
+
+    RC BufferPool::collectCounterValues(unsigned &hitCount, unsigned &missCount) {
+        hitCount = hitCounter;
+        missCount = missCounter;
+        return 0;
+    }
+
 } // namespace PeterDB
\ No newline at end of file
@@ -144,7 +144,7 @@ namespace PeterDB {
             }
         }
         bitmapBufferBytes = attrsBufferSize % 8 ? attrsBufferSize / 8 + 1 : attrsBufferSize / 8;
-        bitmapBuffer = malloc(bitmapBytes);
+        bitmapBuffer = malloc(bitmapBufferBytes);
         attrsSize = attrs.size();
         bitmapBytes = attrsSize % 8 ? attrsSize / 8 + 1 : attrsSize / 8;
         bitmap = malloc(bitmapBytes);
@@ -202,6 +202,264 @@ namespace PeterDB {
         return 0;
     }
 
+    Sort::Sort(Iterator *input, const std::vector<SortKey> &keys, const unsigned int numPages, const unsigned int limit) : rbfm(RecordBasedFileManager::instance()), input(input), numPages(numPages), limit(limit) {
+        assert(numPages > 0 && !keys.empty());
+        input->getAttributes(attrs);
+        attrsSize = attrs.size();
+        bitmapBytes = attrsSize % 8 ? attrsSize / 8 + 1 : attrsSize / 8;
+        maxTupleLength = bitmapBytes;
+        for (int i = 0; i < attrsSize; i++) {
+            attrNames.push_back(attrs[i].name);
+            maxTupleLength = maxTupleLength + sizeof(int) + (attrs[i].type == 2 ? attrs[i].length : 0);
+        }
+        for (const auto &key : keys) {
+            int keyPos = -1;
+            for (int i = 0; i < attrsSize; i++) {
+                if (attrs[i].name == key.attrName) {
+                    keyPos = i;
+                    break;
+                }
+            }
+            assert(keyPos != -1);
+            this->keys.emplace_back(keyPos, key.ascending);
+        }
+        bitmap = malloc(bitmapBytes);
+        runBuffer = malloc(numPages * PAGE_SIZE);
+        tupleBuffer = malloc(PAGE_SIZE);
+
+        // The best limit tuples are picked in one pass when they all fit in the run buffer
+        if (limit != 0 && maxTupleLength <= PAGE_SIZE && limit <= numPages * PAGE_SIZE / maxTupleLength) sortRC = selectTopK();
+        else sortRC = sortInput();
+    }
+
+    Sort::Sort(Iterator *input, const std::string &attrName, const unsigned int numPages) : Sort(input, {{attrName, true}}, numPages) {}
+
+    Sort::~Sort() {
+        closeMerge();
+        for (const auto &fileName : runFileNames) rbfm.destroyFile(fileName);
+        attrs.clear();
+        runDirectory.clear();
+        free(bitmap);
+        free(runBuffer);
+        free(tupleBuffer);
+    }
+
+    int Sort::compareTuples(const char *tuple, const char *other) {
+        int cmp, offset, otherOffset;
+        for (const auto &key : keys) {
+            offset = getAttrOffset(tuple, attrs, key.first, bitmapBytes);
+            otherOffset = getAttrOffset(other, attrs, key.first, bitmapBytes);
+            if (offset == -1 || otherOffset == -1) cmp = (offset != -1) - (otherOffset != -1);
+            else cmp = compareAttrs(tuple + offset, other + otherOffset, attrs[key.first].type);
+            if (cmp != 0) return key.second ? cmp : -cmp;
+        }
+        return 0;
+    }
+
+    bool Sort::mergesBefore(unsigned run, unsigned other) {
+        if (run == mergeTuples.size()) return true;
+        if (other == mergeTuples.size()) return false;
+        if (mergeDone[run] || mergeDone[other]) return !mergeDone[run];
+        // Ties go to the earlier run, which holds the earlier input, so the merge keeps the sort stable
+        int cmp = compareTuples(mergeTuples[run], mergeTuples[other]);
+        return cmp < 0 || (cmp == 0 && run < other);
+    }
+
+    void Sort::adjustLoserTree(unsigned run) {
+        // Replay the matches from the leaf of run up to the root, leaving the loser at every node
+        for (unsigned node = (run + mergeTuples.size()) / 2; node > 0; node = node / 2) {
+            if (mergesBefore(loserTree[node], run)) std::swap(run, loserTree[node]);
+        }
+        loserTree[0] = run;
+    }
+
+    void Sort::fillRunBuffer(bool &inputHasNext) {
+        runDirectory.clear();
+        runIndex = 0;
+        int tupleLength = getTupleLength((char *) tupleBuffer, attrs, attrsSize, (char *) bitmap, bitmapBytes);
+        int offset = 0;
+        while ((unsigned) (offset + tupleLength) <= numPages * PAGE_SIZE) {
+            std::memcpy((char *) runBuffer + offset, tupleBuffer, tupleLength);
+            runDirectory.emplace_back(offset, tupleLength);
+            offset = offset + tupleLength;
+            if (input->getNextTuple(tupleBuffer) != 0) {
+                inputHasNext = false;
+                break;
+            }
+            tupleLength = getTupleLength((char *) tupleBuffer, attrs, attrsSize, (char *) bitmap, bitmapBytes);
+        }
+        std::stable_sort(runDirectory.begin(), runDirectory.end(), [this](const std::pair<int, int> &tuple, const std::pair<int, int> &other) {
+            return compareTuples((char *) runBuffer + tuple.first, (char *) runBuffer + other.first) < 0;
+        });
+    }
+
+    RC Sort::selectTopK() {
+        // A heap of the best tuples so far in slots of maxTupleLength, the worst one on top
+        std::vector<unsigned> order;        // input position of the tuple in each slot, later ones lose ties
+        auto worse = [this, &order](const std::pair<int, int> &tuple, const std::pair<int, int> &other) {
+            int cmp = compareTuples((char *) runBuffer + tuple.first, (char *) runBuffer + other.first);
+            return cmp < 0 || (cmp == 0 && order[tuple.first / maxTupleLength] < order[other.first / maxTupleLength]);
+        };
+        int tupleLength;
+        for (unsigned position = 0; input->getNextTuple(tupleBuffer) == 0; position++) {
+            tupleLength = getTupleLength((char *) tupleBuffer, attrs, attrsSize, (char *) bitmap, bitmapBytes);
+            if (tupleLength > maxTupleLength) return -1;
+            if (runDirectory.size() < limit) {
+                int offset = runDirectory.size() * maxTupleLength;
+                std::memcpy((char *) runBuffer + offset, tupleBuffer, tupleLength);
+                order.push_back(position);
+                runDirectory.emplace_back(offset, tupleLength);
+                std::push_heap(runDirectory.begin(), runDirectory.end(), worse);
+                continue;
+            }
+            if (compareTuples((char *) tupleBuffer, (char *) runBuffer + runDirectory.front().first) >= 0) continue;
+            std::pop_heap(runDirectory.begin(), runDirectory.end(), worse);
+            int offset = runDirectory.back().first;
+            std::memcpy((char *) runBuffer + offset, tupleBuffer, tupleLength);
+            order[offset / maxTupleLength] = position;
+            runDirectory.back().second = tupleLength;
+            std::push_heap(runDirectory.begin(), runDirectory.end(), worse);
+        }
+        std::sort_heap(runDirectory.begin(), runDirectory.end(), worse);
+        inMemory = true;
+        return 0;
+    }
+
+    RC Sort::createRun(std::string &fileName, FileHandle &fileHandle) {
+        // Without a free-space map records are appended, so the run scans back in the order it was written
+        RC rc = rbfm.createTempFile("sort_run", fileName);
+        if (rc != 0) return rc;
+        rc = rbfm.openFile(fileName, fileHandle);
+        if (rc != 0) rbfm.destroyFile(fileName);
+        return rc;
+    }
+
+    RC Sort::writeRun() {
+        FileHandle fileHandle;
+        std::string fileName;
+        RID rid;
+        RC rc = createRun(fileName, fileHandle);
+        if (rc != 0) return rc;
+        runFileNames.push_back(fileName);
+        // Tuples past the limit in a run can never be returned
+        unsigned count = limit != 0 ? std::min<unsigned>(limit, runDirectory.size()) : runDirectory.size();
+        for (unsigned i = 0; rc == 0 && i < count; i++) {
+            rc = rbfm.insertRecord(fileHandle, attrs, (char *) runBuffer + runDirectory[i].first, rid);
+        }
+        if (fileHandle.pFile != nullptr && rbfm.closeFile(fileHandle) != 0 && rc == 0) rc = -1;
+        return rc;
+    }
+
+    RC Sort::openMerge(unsigned first, unsigned count) {
+        RC rc;
+        RID rid;
+        for (unsigned run = 0; run < count; run++) {
+            mergeScans.push_back(new RBFM_ScanIterator());
+            mergeTuples.push_back((char *) malloc(PAGE_SIZE));
+            mergeDone.push_back(true);
+            rc = rbfm.openFile(runFileNames[first + run], mergeScans[run]->fileHandle);
+            if (rc != 0) return rc;
+            rc = rbfm.scan(mergeScans[run]->fileHandle, attrs, "", NO_OP, nullptr, attrNames, *mergeScans[run]);
+            if (rc != 0) return rc;
+            mergeDone[run] = mergeScans[run]->getNextRecord(rid, mergeTuples[run]) != 0;
+        }
+        loserTree.assign(count, count);
+        for (unsigned run = count; run > 0; run--) adjustLoserTree(run - 1);
+        return 0;
+    }
+
+    RC Sort::nextMerged(void *data) {
+        if (loserTree.empty() || mergeDone[loserTree[0]]) return QE_EOF;
+        RID rid;
+        unsigned run = loserTree[0];
+        std::memcpy(data, mergeTuples[run], getTupleLength(mergeTuples[run], attrs, attrsSize, (char *) bitmap, bitmapBytes));
+        mergeDone[run] = mergeScans[run]->getNextRecord(rid, mergeTuples[run]) != 0;
+        adjustLoserTree(run);
+        return 0;
+    }
+
+    void Sort::closeMerge() {
+        for (auto scanIterator : mergeScans) {
+            if (scanIterator->fileHandle.pFile != nullptr) scanIterator->close();
+            delete scanIterator;
+        }
+        for (auto tuple : mergeTuples) free(tuple);
+        mergeScans.clear();
+        mergeTuples.clear();
+        mergeDone.clear();
+        loserTree.clear();
+    }
+
+    RC Sort::sortInput() {
+        RC rc;
+        bool inputHasNext = input->getNextTuple(tupleBuffer) == 0;
+        while (inputHasNext) {
+            fillRunBuffer(inputHasNext);
+            if (!inputHasNext && runFileNames.empty()) break;
+            rc = writeRun();
+            if (rc != 0) return rc;
+        }
+        if (runFileNames.empty()) {
+            inMemory = true;
+            return 0;
+        }
+        // Every run is on disk now, the merge holds a page per run instead of the run buffer
+        free(runBuffer);
+        runBuffer = nullptr;
+        // Every run being merged holds a page, one more is left for the output
+        unsigned fanIn = numPages > 2 ? numPages - 1 : 2;
+        // Each pass merges neighbouring runs so runs stay in input order, which the merge needs to be stable
+        while (runFileNames.size() > fanIn) {
+            std::vector<std::string> mergedFileNames;
+            for (unsigned first = 0; first < runFileNames.size(); first = first + fanIn) {
+                unsigned count = std::min<unsigned>(fanIn, runFileNames.size() - first);
+                if (count == 1) {
+                    mergedFileNames.push_back(runFileNames[first]);
+                    continue;
+                }
+                FileHandle fileHandle;
+                std::string fileName;
+                RID rid;
+                rc = openMerge(first, count);
+                if (rc == 0) rc = createRun(fileName, fileHandle);
+                if (rc == 0) mergedFileNames.push_back(fileName);
+                for (unsigned merged = 0; rc == 0 && (limit == 0 || merged < limit) && nextMerged(tupleBuffer) == 0; merged++) {
+                    rc = rbfm.insertRecord(fileHandle, attrs, tupleBuffer, rid);
+                }
+                closeMerge();
+                if (fileHandle.pFile != nullptr && rbfm.closeFile(fileHandle) != 0 && rc == 0) rc = -1;
+                if (rc != 0) {
+                    for (const auto &mergedFileName : mergedFileNames) rbfm.destroyFile(mergedFileName);
+                    return rc;
+                }
+                for (unsigned run = first; run < first + count; run++) rbfm.destroyFile(runFileNames[run]);
+            }
+            runFileNames = mergedFileNames;
+        }
+        return openMerge(0, runFileNames.size());
+    }
+
+    RC Sort::getNextTuple(void *data) {
+        if (sortRC != 0) return sortRC;
+        if (limit != 0 && returned >= limit) return QE_EOF;
+        if (!inMemory) {
+            RC rc = nextMerged(data);
+            if (rc != 0) return rc;
+        } else {
+            if (runIndex >= runDirectory.size()) return QE_EOF;
+            std::memcpy(data, (char *) runBuffer + runDirectory[runIndex].first, runDirectory[runIndex].second);
+            runIndex = runIndex + 1;
+        }
+        returned = returned + 1;
+        return 0;
+    }
+
+    RC Sort::getAttributes(std::vector<Attribute> &attrs) const {
+        attrs.clear();
+        attrs = this->attrs;
+        return 0;
+    }
+
     BNLJoin::BNLJoin(Iterator *leftIn, TableScan *rightIn, const Condition &condition, const unsigned int numPages) : outer(leftIn), inner(rightIn), cond(condition), numPages(numPages) {
         assert(cond.bRhsIsAttr == true && cond.op == EQ_OP);
         leftIn->getAttributes(leftAttrs);
@@ -237,19 +495,21 @@ namespace PeterDB {
         rightBitmap = malloc(rightBitmapBytes);
         bitmap = malloc(bitmapBytes);
 
-        innerBuffer = malloc(PAGE_SIZE);
-        outerBuffer = malloc(numPages * PAGE_SIZE);
+        // A quarter of the pages goes to the inner chunk, at least one so it holds a tuple, the rest to the outer block
+        innerPages = std::max(std::min(numPages / 4, (unsigned) BNLJOIN_INNER_PAGES), 1u);
+        outerPages = numPages > innerPages ? numPages - innerPages : 1;
+        innerBuffer = malloc(innerPages * PAGE_SIZE);
+        outerBuffer = malloc(outerPages * PAGE_SIZE);
         innerTupleBuffer = malloc(PAGE_SIZE);
         outerTupleBuffer = malloc(PAGE_SIZE);
+        spareTable = (JoinSlot *) malloc(getTableSize(1) * sizeof(JoinSlot));
     }
 
     BNLJoin::~BNLJoin() {
         attrs.clear();
         leftAttrs.clear();
         rightAttrs.clear();
-        intHm.clear();
-        floatHm.clear();
-        varCharHm.clear();
+        outerEntries.clear();
         innerBufferDirectory.clear();
         free(leftBitmap);
         free(rightBitmap);
@@ -258,21 +518,28 @@ namespace PeterDB {
         free(outerBuffer);
         free(innerTupleBuffer);
         free(outerTupleBuffer);
+        free(spareTable);
+    }
+
+    unsigned BNLJoin::getTableSize(unsigned entries) {
+        unsigned tableSize = 1;
+        while (tableSize < entries + entries / 3 + 1) tableSize = tableSize * 2;
+        return tableSize;
     }
 
     void BNLJoin::fillInnerBuffer() {
         RC rc;
+        innerBufferDirectory.clear();
+        innerBufferIndex = 0;
         if (!innerHasNext) {
             inner->setIterator();
             rc = inner->getNextTuple(innerTupleBuffer);
             if (rc != 0) return;
             innerHasNext = true;
         }
-        innerBufferDirectory.clear();
-        innerBufferIndex = 0;
         int tupleLength = getTupleLength((char *) innerTupleBuffer, rightAttrs, rightAttrsSize, (char *) rightBitmap, rightBitmapBytes);
         int offset = 0;
-        while (offset + tupleLength <= PAGE_SIZE) {
+        while ((unsigned) (offset + tupleLength) <= innerPages * PAGE_SIZE) {
             if ((((char *) rightBitmap)[innerAttrPos / 8] >> (7 - innerAttrPos % 8) & (unsigned) 1) == 0) {
                 std::memcpy((char *) innerBuffer + offset, innerTupleBuffer, tupleLength);
                 innerBufferDirectory.emplace_back(offset, tupleLength);
@@ -295,25 +562,21 @@ namespace PeterDB {
             if (rc != 0) return rc;
             outerFillingStarted = true;
         }
-        intHm.clear();
-        floatHm.clear();
-        varCharHm.clear();
-        int tupleLength = getTupleLength((char *)outerTupleBuffer, leftAttrs, leftAttrsSize, (char *) leftBitmap, leftBitmapBytes);
-        int offset = 0;
-        int intBuffer; float floatBuffer; std::string varCharBuffer;
-        while (offset + tupleLength <= numPages * PAGE_SIZE) {
-            if (getAttr((char *) outerTupleBuffer, leftAttrs, outerAttrPos, (char *) leftBitmap, leftBitmapBytes, intBuffer, floatBuffer, varCharBuffer)) {
-                switch (leftAttrs[outerAttrPos].type) {
-                    case 0:
-                        intHm[intBuffer].emplace_back(offset, tupleLength);
-                        break;
-                    case 1:
-                        floatHm[floatBuffer].emplace_back(offset, tupleLength);
-                        break;
-                    default:
-                        varCharHm[varCharBuffer].emplace_back(offset, tupleLength);
-                }
-                std::memcpy((char *) outerBuffer + offset,outerTupleBuffer, tupleLength);
+        outerEntries.clear();
+        int tupleLength = getTupleLength((char *) outerTupleBuffer, leftAttrs, leftAttrsSize, (char *) leftBitmap, leftBitmapBytes);
+        int offset = 0, keyOffset;
+        // Tuples fill the outer buffer from the start and the hash table takes its end, both must fit.
+        // The first tuple is always taken so that every block makes progress
+        auto tableOffset = [](int offset) { return (offset + (int) alignof(JoinSlot) - 1) / (int) alignof(JoinSlot) * (int) alignof(JoinSlot); };
+        while (true) {
+            keyOffset = getAttrOffset((char *) outerTupleBuffer, leftAttrs, outerAttrPos, leftBitmapBytes);
+            if (keyOffset != -1) {
+                if (!outerEntries.empty() && tableOffset(offset + tupleLength) + getTableSize(outerEntries.size() + 1) * sizeof(JoinSlot) > outerPages * PAGE_SIZE) break;
+                JoinSlot entry;
+                entry.hash = hashAttr((char *) outerTupleBuffer + keyOffset, leftAttrs[outerAttrPos].type);
+                entry.offset = offset;
+                outerEntries.push_back(entry);
+                std::memcpy((char *) outerBuffer + offset, outerTupleBuffer, tupleLength);
                 offset = offset + tupleLength;
             }
             rc = outer->getNextTuple(outerTupleBuffer);
@@ -321,7 +584,18 @@ namespace PeterDB {
                 outerHasNext = false;
                 break;
             }
-            tupleLength = getTupleLength((char *)outerTupleBuffer, leftAttrs, leftAttrsSize, (char *) leftBitmap, leftBitmapBytes);
+            tupleLength = getTupleLength((char *) outerTupleBuffer, leftAttrs, leftAttrsSize, (char *) leftBitmap, leftBitmapBytes);
+        }
+        // Linear probing keeps the outer tuples of a key in neighbouring slots
+        unsigned tableSize = getTableSize(outerEntries.size());
+        if (tableOffset(offset) + tableSize * sizeof(JoinSlot) <= outerPages * PAGE_SIZE) table = (JoinSlot *) ((char *) outerBuffer + tableOffset(offset));
+        else table = spareTable;
+        tableMask = tableSize - 1;
+        std::memset(table, -1, tableSize * sizeof(JoinSlot));
+        for (const auto &entry : outerEntries) {
+            unsigned slot = entry.hash & tableMask;
+            while (table[slot].offset != -1) slot = (slot + 1) & tableMask;
+            table[slot] = entry;
         }
         return 0;
     }
@@ -346,48 +620,43 @@ namespace PeterDB {
     }
 
     RC BNLJoin::getNextTuple(void *data) {
-        if (innerBufferIndex >= innerBufferDirectory.size()) {
+        RC rc;
+        char *innerTuple, *outerTuple;
+        AttrType type = leftAttrs[outerAttrPos].type;
+        while (true) {
+            if (probing) {
+                // Outer tuples matching the inner one lie among the slots up to the next empty one
+                innerTuple = (char *) innerBuffer + innerBufferDirectory[innerBufferIndex].first;
+                while (table[probeSlot].offset != -1) {
+                    const JoinSlot &slot = table[probeSlot];
+                    probeSlot = (probeSlot + 1) & tableMask;
+                    if (slot.hash != probeHash) continue;
+                    outerTuple = (char *) outerBuffer + slot.offset;
+                    if (compareAttrs(outerTuple + getAttrOffset(outerTuple, leftAttrs, outerAttrPos, leftBitmapBytes), innerTuple + probeKeyOffset, type) == 0) {
+                        joinTuples(slot.offset, getTupleLength(outerTuple, leftAttrs, leftAttrsSize, (char *) leftBitmap, leftBitmapBytes),
+                                   innerBufferDirectory[innerBufferIndex].first, innerBufferDirectory[innerBufferIndex].second, data);
+                        return 0;
+                    }
+                }
+                probing = false;
+                innerBufferIndex = innerBufferIndex + 1;
+            }
+            if (innerBufferIndex < innerBufferDirectory.size()) {
+                innerTuple = (char *) innerBuffer + innerBufferDirectory[innerBufferIndex].first;
+                probeKeyOffset = getAttrOffset(innerTuple, rightAttrs, innerAttrPos, rightBitmapBytes);
+                probeHash = hashAttr(innerTuple + probeKeyOffset, type);
+                probeSlot = probeHash & tableMask;
+                probing = true;
+                continue;
+            }
             if (!innerHasNext) {
-                RC rc = fillOuterBuffer();
+                rc = fillOuterBuffer();
                 if (rc != 0) return rc;
             }
             fillInnerBuffer();
-            if (innerBufferDirectory.empty()) return QE_EOF;
-        }
-        int intBuffer; float floatBuffer; std::string varCharBuffer;
-        getAttr((char *) innerBuffer + innerBufferDirectory[innerBufferIndex].first, rightAttrs, innerAttrPos, (char *) rightBitmap, rightBitmapBytes, intBuffer, floatBuffer, varCharBuffer);
-        int leftOffset, leftLength;
-        switch (rightAttrs[innerAttrPos].type){
-            case 0:
-                if (outerBufferIndex >= intHm[intBuffer].size()) {
-                    outerBufferIndex = 0;
-                    innerBufferIndex = innerBufferIndex + 1;
-                    return getNextTuple(data);
-                }
-                leftOffset = intHm[intBuffer][outerBufferIndex].first;
-                leftLength = intHm[intBuffer][outerBufferIndex].second;
-                break;
-            case 1:
-                if (outerBufferIndex >= floatHm[floatBuffer].size()) {
-                    outerBufferIndex = 0;
-                    innerBufferIndex = innerBufferIndex + 1;
-                    return getNextTuple(data);
-                }
-                leftOffset = floatHm[floatBuffer][outerBufferIndex].first;
-                leftLength = floatHm[floatBuffer][outerBufferIndex].second;
-                break;
-            default:
-                if (outerBufferIndex >= varCharHm[varCharBuffer].size()) {
-                    outerBufferIndex = 0;
-                    innerBufferIndex = innerBufferIndex + 1;
-                    return getNextTuple(data);
-                }
-                leftOffset = varCharHm[varCharBuffer][outerBufferIndex].first;
-                leftLength = varCharHm[varCharBuffer][outerBufferIndex].second;
+            // The inner tuples left after a full chunk may all have null keys, the next outer block still needs a pass
+            if (innerBufferDirectory.empty() && !outerHasNext) return QE_EOF;
         }
-        joinTuples(leftOffset, leftLength, innerBufferDirectory[innerBufferIndex].first, innerBufferDirectory[innerBufferIndex].second, data);
-        outerBufferIndex = outerBufferIndex + 1;
-        return 0;
     }
 
     RC BNLJoin::getAttributes(std::vector<Attribute> &attrs) const {
@@ -421,7 +690,7 @@ namespace PeterDB {
             }
         }
         assert(innerAttrPos != -1);
-        assert(innerAttrs[outerAttrPos].type == outerAttrs[innerAttrPos].type);
+        assert(outerAttrs[outerAttrPos].type == innerAttrs[innerAttrPos].type);
 
         outerBitmapBytes = outerAttrsSize % 8 ? outerAttrsSize / 8 + 1 : outerAttrsSize / 8;
         innerBitmapBytes = innerAttrsSize % 8 ? innerAttrsSize / 8 + 1 : innerAttrsSize / 8;
@@ -432,23 +701,96 @@ namespace PeterDB {
 
         innerTupleBuffer = malloc(PAGE_SIZE);
         outerTupleBuffer = malloc(PAGE_SIZE);
+        outerBuffer = malloc(INLJOIN_BATCH_PAGES * PAGE_SIZE);
     }
 
     INLJoin::~INLJoin() {
         attrs.clear();
         outerAttrs.clear();
         innerAttrs.clear();
+        outerBufferDirectory.clear();
+        matchKey.clear();
+        matches.clear();
+        matchDirectory.clear();
         free(outerBitmap);
         free(innerBitmap);
         free(bitmap);
         free(innerTupleBuffer);
         free(outerTupleBuffer);
+        free(outerBuffer);
+    }
+
+    RC INLJoin::fillOuterBuffer() {
+        if (!outerHasNext) return QE_EOF;
+        RC rc;
+        if (!outerFillingStarted) {
+            rc = outer->getNextTuple(outerTupleBuffer);
+            if (rc != 0) return QE_EOF;
+            outerFillingStarted = true;
+        }
+        outerBufferDirectory.clear();
+        outerBufferIndex = 0;
+        probed = false;
+        int tupleLength = getTupleLength((char *) outerTupleBuffer, outerAttrs, outerAttrsSize, (char *) outerBitmap, outerBitmapBytes);
+        int offset = 0;
+        while (offset + tupleLength <= INLJOIN_BATCH_PAGES * PAGE_SIZE) {
+            // A null key matches nothing
+            if ((((char *) outerBitmap)[outerAttrPos / 8] >> (7 - outerAttrPos % 8) & (unsigned) 1) == 0) {
+                std::memcpy((char *) outerBuffer + offset, outerTupleBuffer, tupleLength);
+                outerBufferDirectory.emplace_back(offset, tupleLength);
+                offset = offset + tupleLength;
+            }
+            rc = outer->getNextTuple(outerTupleBuffer);
+            if (rc != 0) {
+                outerHasNext = false;
+                break;
+            }
+            tupleLength = getTupleLength((char *) outerTupleBuffer, outerAttrs, outerAttrsSize, (char *) outerBitmap, outerBitmapBytes);
+        }
+        // In key order, neighbouring lookups land in the same leaf and equal keys are looked up once
+        AttrType type = outerAttrs[outerAttrPos].type;
+        std::stable_sort(outerBufferDirectory.begin(), outerBufferDirectory.end(), [this, type](const std::pair<int, int> &tuple, const std::pair<int, int> &other) {
+            const char *tupleBuffer = (char *) outerBuffer + tuple.first, *otherBuffer = (char *) outerBuffer + other.first;
+            return compareAttrs(tupleBuffer + getAttrOffset(tupleBuffer, outerAttrs, outerAttrPos, outerBitmapBytes),
+                                otherBuffer + getAttrOffset(otherBuffer, outerAttrs, outerAttrPos, outerBitmapBytes), type) < 0;
+        });
+        return 0;
+    }
+
+    // The tuples of a key that fit are kept for the next outer tuple with that key. Those of a key with more are
+    // taken a window at a time, and the open index scan seeks back to the key for each outer tuple
+    void INLJoin::probe(const char *key) {
+        matchIndex = 0;
+        AttrType type = outerAttrs[outerAttrPos].type;
+        if (matchesWhole && !matchKey.empty() && compareAttrs(key, matchKey.data(), type) == 0) return;
+        int keyLength = 0;
+        if (type == 2) std::memcpy(&keyLength, key, sizeof(int));
+        keyLength = keyLength + sizeof(int);
+        matchKey.assign(key, key + keyLength);
+        inner->setIterator(matchKey.data(), matchKey.data(), true, true);
+        fillMatches();
+        matchesWhole = !matchesLeft;
     }
 
-    void INLJoin::joinTuples(void *data) {
-        int outerTupleLength = getTupleLength((char *) outerTupleBuffer, outerAttrs, outerAttrsSize, (char *) outerBitmap, outerBitmapBytes);
-        int innerTupleLength = getTupleLength((char *) innerTupleBuffer, innerAttrs, innerAttrsSize, (char *) innerBitmap, innerBitmapBytes);
+    void INLJoin::fillMatches() {
+        matchIndex = 0;
+        matches.clear();
+        matchDirectory.clear();
+        matchesLeft = false;
+        while (inner->getNextTuple(innerTupleBuffer) == 0) {
+            int tupleLength = getTupleLength((char *) innerTupleBuffer, innerAttrs, innerAttrsSize, (char *) innerBitmap, innerBitmapBytes);
+            matchDirectory.emplace_back(matches.size(), tupleLength);
+            matches.insert(matches.end(), (char *) innerTupleBuffer, (char *) innerTupleBuffer + tupleLength);
+            if (matches.size() >= INLJOIN_BATCH_PAGES * PAGE_SIZE) {
+                matchesLeft = true;
+                return;
+            }
+        }
+    }
 
+    void INLJoin::joinTuples(int outerOffset, int outerLength, int innerOffset, int innerLength, void *data) {
+        std::memcpy(outerBitmap, (char *) outerBuffer + outerOffset, outerBitmapBytes);
+        std::memcpy(innerBitmap, matches.data() + innerOffset, innerBitmapBytes);
         std::memset(bitmap, 0 , bitmapBytes);
         for (int i = 0; i < outerAttrsSize; i++) {
             if (((char *) outerBitmap)[i / 8] >> (7 - i % 8) & (unsigned) 1) {
@@ -461,35 +803,36 @@ namespace PeterDB {
             }
         }
         std::memcpy(data, bitmap, bitmapBytes);
-        std::memcpy((char *) data + bitmapBytes, (char *) outerTupleBuffer + outerBitmapBytes, outerTupleLength - outerBitmapBytes);
-        std::memcpy((char *) data + bitmapBytes + outerTupleLength - outerBitmapBytes, (char *) innerTupleBuffer + innerBitmapBytes, innerTupleLength - innerBitmapBytes);
+        std::memcpy((char *) data + bitmapBytes, (char *) outerBuffer + outerOffset + outerBitmapBytes, outerLength - outerBitmapBytes);
+        std::memcpy((char *) data + bitmapBytes + outerLength - outerBitmapBytes, matches.data() + innerOffset + innerBitmapBytes, innerLength - innerBitmapBytes);
     }
 
     RC INLJoin::getNextTuple(void *data) {
-        if (!innerHasNext) {
-            RC rc = outer->getNextTuple(outerTupleBuffer);
-            if (rc != 0) return QE_EOF;
-            int intBuffer; float floatBuffer; std::string varCharBuffer;
-            getAttr((char *) outerTupleBuffer, outerAttrs, outerAttrPos, (char *) outerBitmap, outerBitmapBytes, intBuffer, floatBuffer, varCharBuffer);
-            switch (innerAttrs[innerAttrPos].type) {
-                case 0:
-                    inner->setIterator(&intBuffer, &intBuffer, true, true);
-                    break;
-                case 1:
-                    inner->setIterator(&floatBuffer, &floatBuffer, true, true);
-                    break;
-                default:
-                    inner->setIterator(&varCharBuffer, &varCharBuffer, true, true);
+        while (true) {
+            if (outerBufferIndex < outerBufferDirectory.size()) {
+                const std::pair<int, int> &outerTuple = outerBufferDirectory[outerBufferIndex];
+                if (!probed) {
+                    const char *outerTupleData = (char *) outerBuffer + outerTuple.first;
+                    probe(outerTupleData + getAttrOffset(outerTupleData, outerAttrs, outerAttrPos, outerBitmapBytes));
+                    probed = true;
+                }
+                if (matchIndex < matchDirectory.size()) {
+                    joinTuples(outerTuple.first, outerTuple.second, matchDirectory[matchIndex].first, matchDirectory[matchIndex].second, data);
+                    matchIndex = matchIndex + 1;
+                    return 0;
+                }
+                if (matchesLeft) {
+                    fillMatches();
+                    matchesWhole = false;
+                    continue;
+                }
+                outerBufferIndex = outerBufferIndex + 1;
+                probed = false;
+                continue;
             }
-            innerHasNext = true;
-        }
-        RC rc = inner->getNextTuple(innerTupleBuffer);
-        if (rc != 0) {
-            innerHasNext = false;
-            return getNextTuple(data);
+            RC rc = fillOuterBuffer();
+            if (rc != 0) return rc;
         }
-        joinTuples(data);
-        return 0;
     }
 
     RC INLJoin::getAttributes(std::vector<Attribute> &attrs) const {
@@ -498,20 +841,554 @@ namespace PeterDB {
         return 0;
     }
 
-    GHJoin::GHJoin(Iterator *leftIn, Iterator *rightIn, const Condition &condition, const unsigned int numPartitions) {
+    SMJoin::SMJoin(Iterator *leftIn, Iterator *rightIn, const Condition &condition, const unsigned int numPages) : rbfm(RecordBasedFileManager::instance()), left(leftIn), right(rightIn), cond(condition), numPages(std::max(numPages, 1u)) {
+        assert(cond.bRhsIsAttr == true && cond.op == EQ_OP);
+        leftIn->getAttributes(leftAttrs);
+        rightIn->getAttributes(rightAttrs);
+        for (const auto &attr : leftAttrs) attrs.push_back(attr);
+        for (const auto &attr : rightAttrs) {
+            attrs.push_back(attr);
+            rightAttrNames.push_back(attr.name);
+        }
+
+        leftAttrsSize = leftAttrs.size();
+        rightAttrsSize = rightAttrs.size();
+        attrsSize = leftAttrsSize + rightAttrsSize;
+
+        for (int i = 0; i < leftAttrsSize; i++) {
+            if (leftAttrs[i].name == cond.lhsAttr) {
+                leftAttrPos = i;
+                break;
+            }
+        }
+        assert(leftAttrPos != -1);
+
+        for (int i = 0; i < rightAttrsSize; i++) {
+            if (rightAttrs[i].name == cond.rhsAttr) {
+                rightAttrPos = i;
+                break;
+            }
+        }
+        assert(rightAttrPos != -1);
+        assert(leftAttrs[leftAttrPos].type == rightAttrs[rightAttrPos].type);
+
+        leftBitmapBytes = leftAttrsSize % 8 ? leftAttrsSize / 8 + 1 : leftAttrsSize / 8;
+        rightBitmapBytes = rightAttrsSize % 8 ? rightAttrsSize / 8 + 1 : rightAttrsSize / 8;
+        bitmapBytes = attrsSize % 8 ? attrsSize / 8 + 1 : attrsSize / 8;
+        leftBitmap = malloc(leftBitmapBytes);
+        rightBitmap = malloc(rightBitmapBytes);
+        bitmap = malloc(bitmapBytes);
+        leftTupleBuffer = malloc(PAGE_SIZE);
+        rightTupleBuffer = malloc(PAGE_SIZE);
+        groupBuffer = malloc(this->numPages * PAGE_SIZE);
+        groupKey = malloc(PAGE_SIZE);
+        groupTupleBuffer = malloc(PAGE_SIZE);
+
+        // An index scan on the join key already returns its tuples in key order
+        auto leftIndexScan = dynamic_cast<IndexScan *>(leftIn);
+        auto rightIndexScan = dynamic_cast<IndexScan *>(rightIn);
+        bool sortLeft = leftIndexScan == nullptr || !leftIndexScan->isOrderedOn(cond.lhsAttr);
+        bool sortRight = rightIndexScan == nullptr || !rightIndexScan->isOrderedOn(cond.rhsAttr);
+        unsigned sortPages = sortLeft && sortRight ? std::max(this->numPages / 2, 1u) : this->numPages;
+        if (sortLeft) left = leftSort = new Sort(leftIn, cond.lhsAttr, sortPages);
+        if (sortRight) right = rightSort = new Sort(rightIn, cond.rhsAttr, sortPages);
+    }
+
+    SMJoin::~SMJoin() {
+        if (groupHandle.pFile != nullptr) rbfm.closeFile(groupHandle);
+        closeGroup();
+        delete leftSort;
+        delete rightSort;
+        attrs.clear();
+        leftAttrs.clear();
+        rightAttrs.clear();
+        free(leftBitmap);
+        free(rightBitmap);
+        free(bitmap);
+        free(leftTupleBuffer);
+        free(rightTupleBuffer);
+        free(groupBuffer);
+        free(groupKey);
+        free(groupTupleBuffer);
+    }
+
+    bool SMJoin::nextLeft() {
+        while (left->getNextTuple(leftTupleBuffer) == 0) {
+            leftKeyOffset = getAttrOffset((char *) leftTupleBuffer, leftAttrs, leftAttrPos, leftBitmapBytes);
+            if (leftKeyOffset == -1) continue;
+            leftLength = getTupleLength((char *) leftTupleBuffer, leftAttrs, leftAttrsSize, (char *) leftBitmap, leftBitmapBytes);
+            return true;
+        }
+        return false;
+    }
+
+    bool SMJoin::nextRight() {
+        while (right->getNextTuple(rightTupleBuffer) == 0) {
+            rightKeyOffset = getAttrOffset((char *) rightTupleBuffer, rightAttrs, rightAttrPos, rightBitmapBytes);
+            if (rightKeyOffset == -1) continue;
+            rightLength = getTupleLength((char *) rightTupleBuffer, rightAttrs, rightAttrsSize, (char *) rightBitmap, rightBitmapBytes);
+            return true;
+        }
+        return false;
+    }
+
+    RC SMJoin::spillGroup() {
+        // Without a free-space map records are appended, so the group scans back in the order it was written
+        RC rc = rbfm.createTempFile("smjoin_group", groupFileName);
+        if (rc != 0) return rc;
+        groupSpilled = true;
+        rc = rbfm.openFile(groupFileName, groupHandle);
+        RID rid;
+        for (unsigned i = 0; rc == 0 && i < groupDirectory.size(); i++) {
+            rc = rbfm.insertRecord(groupHandle, rightAttrs, (char *) groupBuffer + groupDirectory[i].first, rid);
+        }
+        groupDirectory.clear();
+        groupLength = 0;
+        return rc;
+    }
+
+    RC SMJoin::readGroup() {
+        RC rc = 0;
+        RID rid;
+        AttrType type = rightAttrs[rightAttrPos].type;
+        std::memcpy(groupKey, rightTupleBuffer, rightLength);
+        groupKeyOffset = rightKeyOffset;
+        grouped = true;
+        while (rc == 0 && rightHasNext && compareAttrs((char *) rightTupleBuffer + rightKeyOffset, (char *) groupKey + groupKeyOffset, type) == 0) {
+            // A group larger than the buffer goes to a file, scanned again for every left tuple of its key
+            if (!groupSpilled && (unsigned) (groupLength + rightLength) > numPages * PAGE_SIZE) {
+                rc = spillGroup();
+                if (rc != 0) break;
+            }
+            if (groupSpilled) {
+                rc = rbfm.insertRecord(groupHandle, rightAttrs, rightTupleBuffer, rid);
+            } else {
+                std::memcpy((char *) groupBuffer + groupLength, rightTupleBuffer, rightLength);
+                groupDirectory.emplace_back(groupLength, rightLength);
+                groupLength = groupLength + rightLength;
+            }
+            rightHasNext = nextRight();
+        }
+        if (groupHandle.pFile != nullptr && rbfm.closeFile(groupHandle) != 0 && rc == 0) rc = -1;
+        return rc;
+    }
+
+    RC SMJoin::startGroup() {
+        if (!groupSpilled) {
+            groupIndex = 0;
+            return 0;
+        }
+        RC rc = rbfm.openFile(groupFileName, groupScan.fileHandle);
+        if (rc != 0) return rc;
+        return rbfm.scan(groupScan.fileHandle, rightAttrs, "", NO_OP, nullptr, rightAttrNames, groupScan);
+    }
+
+    void SMJoin::closeGroup() {
+        if (groupScan.fileHandle.pFile != nullptr) groupScan.close();
+        if (groupSpilled) rbfm.destroyFile(groupFileName);
+        groupSpilled = false;
+        groupDirectory.clear();
+        groupLength = 0;
+        grouped = false;
+    }
+
+    void SMJoin::joinTuples(const char *rightTuple, int rightLength, void *data) {
+        std::memcpy(leftBitmap, leftTupleBuffer, leftBitmapBytes);
+        std::memcpy(rightBitmap, rightTuple, rightBitmapBytes);
+        std::memset(bitmap, 0, bitmapBytes);
+        for (int i = 0; i < leftAttrsSize; i++) {
+            if (((char *) leftBitmap)[i / 8] >> (7 - i % 8) & (unsigned) 1) {
+                ((char *) bitmap)[i / 8] |= (unsigned) 1 << (7 - i % 8);
+            }
+        }
+        for (int i = 0; i < rightAttrsSize; i++) {
+            if (((char *) rightBitmap)[i / 8] >> (7 - i % 8) & (unsigned) 1) {
+                ((char *) bitmap)[(i + leftAttrsSize) / 8] |= (unsigned) 1 << (7 - (i + leftAttrsSize) % 8);
+            }
+        }
+        std::memcpy(data, bitmap, bitmapBytes);
+        std::memcpy((char *) data + bitmapBytes, (char *) leftTupleBuffer + leftBitmapBytes, leftLength - leftBitmapBytes);
+        std::memcpy((char *) data + bitmapBytes + leftLength - leftBitmapBytes, rightTuple + rightBitmapBytes, rightLength - rightBitmapBytes);
+    }
+
+    RC SMJoin::getNextTuple(void *data) {
+        if (!started) {
+            leftHasNext = nextLeft();
+            rightHasNext = nextRight();
+            started = true;
+        }
+        RC rc;
+        RID rid;
+        AttrType type = leftAttrs[leftAttrPos].type;
+        while (true) {
+            if (grouped) {
+                if (!groupSpilled && groupIndex < groupDirectory.size()) {
+                    joinTuples((char *) groupBuffer + groupDirectory[groupIndex].first, groupDirectory[groupIndex].second, data);
+                    groupIndex = groupIndex + 1;
+                    return 0;
+                }
+                if (groupSpilled) {
+                    if (groupScan.getNextRecord(rid, groupTupleBuffer) == 0) {
+                        joinTuples((char *) groupTupleBuffer, getTupleLength((char *) groupTupleBuffer, rightAttrs, rightAttrsSize, (char *) rightBitmap, rightBitmapBytes), data);
+                        return 0;
+                    }
+                    groupScan.close();
+                }
+                // The next left tuple joins the same group again if it has the same key
+                leftHasNext = nextLeft();
+                if (leftHasNext && compareAttrs((char *) leftTupleBuffer + leftKeyOffset, (char *) groupKey + groupKeyOffset, type) == 0) {
+                    rc = startGroup();
+                    if (rc != 0) return rc;
+                    continue;
+                }
+                closeGroup();
+            }
+            if (!leftHasNext || !rightHasNext) return QE_EOF;
+            int cmp = compareAttrs((char *) leftTupleBuffer + leftKeyOffset, (char *) rightTupleBuffer + rightKeyOffset, type);
+            if (cmp < 0) leftHasNext = nextLeft();
+            else if (cmp > 0) rightHasNext = nextRight();
+            else {
+                rc = readGroup();
+                if (rc == 0) rc = startGroup();
+                if (rc != 0) return rc;
+            }
+        }
+    }
+
+    RC SMJoin::getAttributes(std::vector<Attribute> &attrs) const {
+        attrs.clear();
+        attrs = this->attrs;
+        return 0;
+    }
+
+    GHJoin::GHJoin(Iterator *leftIn, Iterator *rightIn, const Condition &condition, const unsigned int numPartitions) : rbfm(RecordBasedFileManager::instance()), cond(condition), numPartitions(numPartitions) {
+        assert(cond.bRhsIsAttr == true && cond.op == EQ_OP && numPartitions > 0);
+        leftIn->getAttributes(leftAttrs);
+        rightIn->getAttributes(rightAttrs);
+        for (const auto &attr : leftAttrs) {
+            attrs.push_back(attr);
+            leftAttrNames.push_back(attr.name);
+        }
+        for (const auto &attr : rightAttrs) {
+            attrs.push_back(attr);
+            rightAttrNames.push_back(attr.name);
+        }
+
+        leftAttrsSize = leftAttrs.size();
+        rightAttrsSize = rightAttrs.size();
+        attrsSize = leftAttrsSize + rightAttrsSize;
+
+        for (int i = 0; i < leftAttrsSize; i++) {
+            if (leftAttrs[i].name == cond.lhsAttr) {
+                leftAttrPos = i;
+                break;
+            }
+        }
+        assert(leftAttrPos != -1);
+
+        for (int i = 0; i < rightAttrsSize; i++) {
+            if (rightAttrs[i].name == cond.rhsAttr) {
+                rightAttrPos = i;
+                break;
+            }
+        }
+        assert(rightAttrPos != -1);
+        assert(leftAttrs[leftAttrPos].type == rightAttrs[rightAttrPos].type);
+
+        leftBitmapBytes = leftAttrsSize % 8 ? leftAttrsSize / 8 + 1 : leftAttrsSize / 8;
+        rightBitmapBytes = rightAttrsSize % 8 ? rightAttrsSize / 8 + 1 : rightAttrsSize / 8;
+        bitmapBytes = attrsSize % 8 ? attrsSize / 8 + 1 : attrsSize / 8;
+        leftBitmap = malloc(leftBitmapBytes);
+        rightBitmap = malloc(rightBitmapBytes);
+        bitmap = malloc(bitmapBytes);
 
+        buildBuffer = malloc(GHJOIN_BUILD_PAGES * PAGE_SIZE);
+        buildTupleBuffer = malloc(PAGE_SIZE);
+        probeTupleBuffer = malloc(PAGE_SIZE);
+
+        // Both inputs are consumed here, the join then works through the partitions on disk
+        partitionRC = partitionInputs(leftIn, rightIn);
     }
 
     GHJoin::~GHJoin() {
+        if (joining) {
+            buildScan.close();
+            probeScan.close();
+        }
+        for (const auto &fileName : fileNames) rbfm.destroyFile(fileName);
+        attrs.clear();
+        leftAttrs.clear();
+        rightAttrs.clear();
+        intHm.clear();
+        floatHm.clear();
+        varCharHm.clear();
+        free(leftBitmap);
+        free(rightBitmap);
+        free(bitmap);
+        free(buildBuffer);
+        free(buildTupleBuffer);
+        free(probeTupleBuffer);
+    }
 
+    int GHJoin::getPartition(char *tupleBuffer, bool left, unsigned depth) {
+        int intBuffer; float floatBuffer; std::string varCharBuffer;
+        const std::vector<Attribute> &sideAttrs = left ? leftAttrs : rightAttrs;
+        int attrPos = left ? leftAttrPos : rightAttrPos;
+        if (!getAttr(tupleBuffer, sideAttrs, attrPos, (char *) (left ? leftBitmap : rightBitmap),
+                     left ? leftBitmapBytes : rightBitmapBytes, intBuffer, floatBuffer, varCharBuffer)) return -1;
+        unsigned long long hash;
+        switch (sideAttrs[attrPos].type) {
+            case 0:
+                hash = std::hash<int>()(intBuffer);
+                break;
+            case 1:
+                hash = std::hash<float>()(floatBuffer);
+                break;
+            default:
+                hash = std::hash<std::string>()(varCharBuffer);
+        }
+        // Each depth mixes the hash with its own seed so a repartition splits what the level above grouped together
+        hash = hash + (depth + 1) * 0x9e3779b97f4a7c15ULL;
+        hash = (hash ^ (hash >> 33)) * 0xff51afd7ed558ccdULL;
+        hash = (hash ^ (hash >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+        hash = hash ^ (hash >> 33);
+        return (int) (hash % numPartitions);
+    }
+
+    RC GHJoin::createPartitions(unsigned depth, std::vector<FileHandle *> &leftHandles, std::vector<FileHandle *> &rightHandles) {
+        RC rc;
+        for (unsigned i = 0; i < numPartitions; i++) {
+            GHJoinPartition created;
+            created.depth = depth;
+            rc = rbfm.createTempFile("ghjoin_left", created.leftFileName);
+            if (rc != 0) return rc;
+            fileNames.push_back(created.leftFileName);
+            rc = rbfm.createTempFile("ghjoin_right", created.rightFileName);
+            if (rc != 0) return rc;
+            fileNames.push_back(created.rightFileName);
+            leftHandles.push_back(new FileHandle());
+            rc = rbfm.openFile(created.leftFileName, *leftHandles.back());
+            if (rc != 0) return rc;
+            rightHandles.push_back(new FileHandle());
+            rc = rbfm.openFile(created.rightFileName, *rightHandles.back());
+            if (rc != 0) return rc;
+            partitions.push_back(created);
+        }
+        return 0;
+    }
+
+    RC GHJoin::closePartitions(std::vector<FileHandle *> &handles) {
+        RC rc = 0;
+        for (auto handle : handles) {
+            if (handle->pFile != nullptr && rbfm.closeFile(*handle) != 0) rc = -1;
+            delete handle;
+        }
+        handles.clear();
+        return rc;
+    }
+
+    RC GHJoin::partitionInputs(Iterator *leftIn, Iterator *rightIn) {
+        std::vector<FileHandle *> leftHandles, rightHandles;
+        RID rid;
+        int partitionIndex;
+        RC rc = createPartitions(0, leftHandles, rightHandles);
+        while (rc == 0 && leftIn->getNextTuple(buildTupleBuffer) == 0) {
+            partitionIndex = getPartition((char *) buildTupleBuffer, true, 0);
+            if (partitionIndex != -1) rc = rbfm.insertRecord(*leftHandles[partitionIndex], leftAttrs, buildTupleBuffer, rid);
+        }
+        while (rc == 0 && rightIn->getNextTuple(probeTupleBuffer) == 0) {
+            partitionIndex = getPartition((char *) probeTupleBuffer, false, 0);
+            if (partitionIndex != -1) rc = rbfm.insertRecord(*rightHandles[partitionIndex], rightAttrs, probeTupleBuffer, rid);
+        }
+        if (closePartitions(leftHandles) != 0 && rc == 0) rc = -1;
+        if (closePartitions(rightHandles) != 0 && rc == 0) rc = -1;
+        return rc;
+    }
+
+    RC GHJoin::repartition(const GHJoinPartition &oversized) {
+        std::vector<FileHandle *> leftHandles, rightHandles;
+        RBFM_ScanIterator scanIterator;
+        RID rid;
+        int partitionIndex;
+        unsigned depth = oversized.depth + 1;
+        RC rc = createPartitions(depth, leftHandles, rightHandles);
+        if (rc == 0) rc = openScan(oversized.leftFileName, true, scanIterator);
+        if (rc == 0) {
+            while (rc == 0 && scanIterator.getNextRecord(rid, buildTupleBuffer) == 0) {
+                partitionIndex = getPartition((char *) buildTupleBuffer, true, depth);
+                rc = rbfm.insertRecord(*leftHandles[partitionIndex], leftAttrs, buildTupleBuffer, rid);
+            }
+            scanIterator.close();
+        }
+        if (rc == 0) rc = openScan(oversized.rightFileName, false, scanIterator);
+        if (rc == 0) {
+            while (rc == 0 && scanIterator.getNextRecord(rid, probeTupleBuffer) == 0) {
+                partitionIndex = getPartition((char *) probeTupleBuffer, false, depth);
+                rc = rbfm.insertRecord(*rightHandles[partitionIndex], rightAttrs, probeTupleBuffer, rid);
+            }
+            scanIterator.close();
+        }
+        if (closePartitions(leftHandles) != 0 && rc == 0) rc = -1;
+        if (closePartitions(rightHandles) != 0 && rc == 0) rc = -1;
+        if (rc != 0) return rc;
+        // Every tuple of the oversized pair is in the new partitions now
+        for (const auto &fileName : {oversized.leftFileName, oversized.rightFileName}) {
+            rbfm.destroyFile(fileName);
+            fileNames.erase(std::find(fileNames.begin(), fileNames.end(), fileName));
+        }
+        return 0;
+    }
+
+    RC GHJoin::openScan(const std::string &fileName, bool left, RBFM_ScanIterator &scanIterator) {
+        RC rc = rbfm.openFile(fileName, scanIterator.fileHandle);
+        if (rc != 0) return rc;
+        rc = rbfm.scan(scanIterator.fileHandle, left ? leftAttrs : rightAttrs, "", NO_OP, nullptr,
+                       left ? leftAttrNames : rightAttrNames, scanIterator);
+        if (rc != 0) rbfm.closeFile(scanIterator.fileHandle);
+        return rc;
+    }
+
+    RC GHJoin::nextPartition() {
+        RC rc;
+        RID rid;
+        while (!partitions.empty()) {
+            partition = partitions.back();
+            partitions.pop_back();
+            rc = openScan(partition.leftFileName, true, buildScan);
+            if (rc != 0) return rc;
+            if (buildScan.fileHandle.getNumberOfPages() > GHJOIN_BUILD_PAGES && partition.depth < GHJOIN_MAX_DEPTH) {
+                buildScan.close();
+                rc = repartition(partition);
+                if (rc != 0) return rc;
+                continue;
+            }
+            buildHasNext = buildScan.getNextRecord(rid, buildTupleBuffer) == 0;
+            if (!buildHasNext) {
+                buildScan.close();
+                continue;
+            }
+            rc = openScan(partition.rightFileName, false, probeScan);
+            if (rc != 0) {
+                buildScan.close();
+                return rc;
+            }
+            fillBuildBuffer();
+            return 0;
+        }
+        return QE_EOF;
+    }
+
+    void GHJoin::fillBuildBuffer() {
+        intHm.clear();
+        floatHm.clear();
+        varCharHm.clear();
+        RID rid;
+        int tupleLength = getTupleLength((char *) buildTupleBuffer, leftAttrs, leftAttrsSize, (char *) leftBitmap, leftBitmapBytes);
+        int offset = 0;
+        int intBuffer; float floatBuffer; std::string varCharBuffer;
+        // A partition still over the memory budget after the last repartition is joined one buffer at a time
+        while (offset + tupleLength <= GHJOIN_BUILD_PAGES * PAGE_SIZE) {
+            getAttr((char *) buildTupleBuffer, leftAttrs, leftAttrPos, (char *) leftBitmap, leftBitmapBytes, intBuffer, floatBuffer, varCharBuffer);
+            switch (leftAttrs[leftAttrPos].type) {
+                case 0:
+                    intHm[intBuffer].emplace_back(offset, tupleLength);
+                    break;
+                case 1:
+                    floatHm[floatBuffer].emplace_back(offset, tupleLength);
+                    break;
+                default:
+                    varCharHm[varCharBuffer].emplace_back(offset, tupleLength);
+            }
+            std::memcpy((char *) buildBuffer + offset, buildTupleBuffer, tupleLength);
+            offset = offset + tupleLength;
+            if (buildScan.getNextRecord(rid, buildTupleBuffer) != 0) {
+                buildHasNext = false;
+                break;
+            }
+            tupleLength = getTupleLength((char *) buildTupleBuffer, leftAttrs, leftAttrsSize, (char *) leftBitmap, leftBitmapBytes);
+        }
+    }
+
+    void GHJoin::probe() {
+        int intBuffer; float floatBuffer; std::string varCharBuffer;
+        matches = nullptr;
+        matchIndex = 0;
+        probeLength = getTupleLength((char *) probeTupleBuffer, rightAttrs, rightAttrsSize, (char *) rightBitmap, rightBitmapBytes);
+        getAttr((char *) probeTupleBuffer, rightAttrs, rightAttrPos, (char *) rightBitmap, rightBitmapBytes, intBuffer, floatBuffer, varCharBuffer);
+        switch (rightAttrs[rightAttrPos].type) {
+            case 0: {
+                auto it = intHm.find(intBuffer);
+                if (it != intHm.end()) matches = &it->second;
+                break;
+            }
+            case 1: {
+                auto it = floatHm.find(floatBuffer);
+                if (it != floatHm.end()) matches = &it->second;
+                break;
+            }
+            default: {
+                auto it = varCharHm.find(varCharBuffer);
+                if (it != varCharHm.end()) matches = &it->second;
+            }
+        }
+    }
+
+    void GHJoin::joinTuples(int leftOffset, int leftLength, void *data) {
+        std::memcpy(leftBitmap, (char *) buildBuffer + leftOffset, leftBitmapBytes);
+        std::memcpy(rightBitmap, probeTupleBuffer, rightBitmapBytes);
+        std::memset(bitmap, 0, bitmapBytes);
+        for (int i = 0; i < leftAttrsSize; i++) {
+            if (((char *) leftBitmap)[i / 8] >> (7 - i % 8) & (unsigned) 1) {
+                ((char *) bitmap)[i / 8] |= (unsigned) 1 << (7 - i % 8);
+            }
+        }
+        for (int i = 0; i < rightAttrsSize; i++) {
+            if (((char *) rightBitmap)[i / 8] >> (7 - i % 8) & (unsigned) 1) {
+                ((char *) bitmap)[(i + leftAttrsSize) / 8] |= (unsigned) 1 << (7 - (i + leftAttrsSize) % 8);
+            }
+        }
+        std::memcpy(data, bitmap, bitmapBytes);
+        std::memcpy((char *) data + bitmapBytes, (char *) buildBuffer + leftOffset + leftBitmapBytes, leftLength - leftBitmapBytes);
+        std::memcpy((char *) data + bitmapBytes + leftLength - leftBitmapBytes, (char *) probeTupleBuffer + rightBitmapBytes, probeLength - rightBitmapBytes);
     }
 
     RC GHJoin::getNextTuple(void *data) {
-        return -1;
+        if (partitionRC != 0) return partitionRC;
+        RC rc;
+        RID rid;
+        while (true) {
+            if (matches != nullptr && matchIndex < matches->size()) {
+                joinTuples((*matches)[matchIndex].first, (*matches)[matchIndex].second, data);
+                matchIndex = matchIndex + 1;
+                return 0;
+            }
+            matches = nullptr;
+            if (joining) {
+                if (probeScan.getNextRecord(rid, probeTupleBuffer) == 0) {
+                    probe();
+                    continue;
+                }
+                probeScan.close();
+                if (buildHasNext) {
+                    // The right partition is probed again with the next buffer of the left one
+                    fillBuildBuffer();
+                    rc = openScan(partition.rightFileName, false, probeScan);
+                    if (rc == 0) continue;
+                } else rc = 0;
+                buildScan.close();
+                joining = false;
+                if (rc != 0) return rc;
+            }
+            rc = nextPartition();
+            if (rc != 0) return rc;
+            joining = true;
+        }
     }
 
     RC GHJoin::getAttributes(std::vector<Attribute> &attrs) const {
-        return -1;
+        attrs.clear();
+        attrs = this->attrs;
+        return 0;
     }
 
     Aggregate::Aggregate(Iterator *input, const Attribute &aggAttr, AggregateOp op) : iter(input), aggAttr(aggAttr), op(op), hasGroupBy(false) {
@@ -1,5 +1,7 @@
 #include "src/include/rbfm.h"
 
+#include <algorithm>
+
 namespace PeterDB {
     RecordBasedFileManager &RecordBasedFileManager::instance() {
         static RecordBasedFileManager _rbf_manager = RecordBasedFileManager();
@@ -14,16 +16,23 @@ namespace PeterDB {
 
     RecordBasedFileManager &RecordBasedFileManager::operator=(const RecordBasedFileManager &) = default;
 
-    RC RecordBasedFileManager::createFile(const std::string &fileName) {
-        return PagedFileManager::instance().createFile(fileName);
+    RC RecordBasedFileManager::createFile(const std::string &fileName, bool freeSpaceMap) {
+        return PagedFileManager::instance().createFile(fileName, freeSpaceMap);
+    }
+
+    RC RecordBasedFileManager::createTempFile(const std::string &prefix, std::string &fileName) {
+        return PagedFileManager::instance().createTempFile(prefix, fileName, false);
     }
 
     RC RecordBasedFileManager::destroyFile(const std::string &fileName) {
         return PagedFileManager::instance().destroyFile(fileName);
     }
 
-    RC RecordBasedFileManager::openFile(const std::string &fileName, FileHandle &fileHandle) {
-        return PagedFileManager::instance().openFile(fileName, fileHandle);
+    RC RecordBasedFileManager::openFile(const std::string &fileName, FileHandle &fileHandle, bool mapped) {
+        RC rc = PagedFileManager::instance().openFile(fileName, fileHandle, mapped);
+        if (rc != 0) return rc;
+        fileHandle.writeBack = !mapped;
+        return 0;
     }
 
     RC RecordBasedFileManager::closeFile(FileHandle &fileHandle) {
@@ -36,6 +45,12 @@ namespace PeterDB {
         return fileHandle.readPage(pageNum, fileHandle.pageBuffer);
     }
 
+    RC RecordBasedFileManager::writePageBuffer(FileHandle &fileHandle, unsigned pageNum) {
+        RC rc = fileHandle.writePage(pageNum, fileHandle.pageBuffer);
+        if (rc != 0) return rc;
+        return fileHandle.setPageFreeSpace(pageNum, getFreeSpace(fileHandle));
+    }
+
     RC RecordBasedFileManager::appendEmptyPage(FileHandle &fileHandle) {
         fileHandle.curPageNum = fileHandle.getNumberOfPages();
         std::memset(fileHandle.pageBuffer, 0, PAGE_SIZE);
@@ -97,15 +112,11 @@ namespace PeterDB {
     unsigned RecordBasedFileManager::findFreePage(FileHandle &fileHandle) {
         if (isCurrentPageFree(fileHandle)) return fileHandle.curPageNum;
         unsigned numberOfPages = fileHandle.getNumberOfPages();
-        /*
-        for (unsigned pageNum = 0; pageNum < numberOfPages; pageNum++) {
+        unsigned pageNum = fileHandle.findPageWithFreeSpace(fileHandle.recordLength + sizeof(Slot));
+        if (pageNum < numberOfPages) {
             getPageBuffer(fileHandle, pageNum);
-            unsigned short freeSpace = getFreeSpace(fileHandle);
-            if (fileHandle.recordLength > freeSpace) continue;
-            bool hasFreeSlot = getFreeSlotNum(fileHandle) != getNumberOfSlot(fileHandle);
-            if (hasFreeSlot || fileHandle.recordLength + sizeof(Slot) <= freeSpace) return pageNum;
+            if (isCurrentPageFree(fileHandle)) return pageNum;
         }
-         */
         appendEmptyPage(fileHandle);
         return numberOfPages;
     }
@@ -165,7 +176,10 @@ namespace PeterDB {
     RC RecordBasedFileManager::insertRecord(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor,
                                             const void *data, RID &rid) {
         if (toRecordBuffer(fileHandle, recordDescriptor, data) != 0) return ERR_RECORD_FROM_DATA_FAILED;
+        return insertRecordBuffer(fileHandle, rid);
+    }
 
+    RC RecordBasedFileManager::insertRecordBuffer(FileHandle &fileHandle, RID &rid) {
         rid.pageNum = findFreePage(fileHandle);
         unsigned short startOfFreeSpace = getStartOfFreeSpace(fileHandle);
         rid.slotNum = getFreeSlotNum(fileHandle);
@@ -184,7 +198,7 @@ namespace PeterDB {
         startOfFreeSpace = startOfFreeSpace + fileHandle.recordLength;
         std::memcpy((char *) fileHandle.pageBuffer + PAGE_SIZE - sizeof(unsigned short), &startOfFreeSpace, sizeof(unsigned short));
 
-        return fileHandle.writePage(rid.pageNum, fileHandle.pageBuffer);
+        return writePageBuffer(fileHandle, rid.pageNum);
     }
 
     RC RecordBasedFileManager::getRecordBuffer(FileHandle &fileHandle, const RID &rid, bool recursive) {
@@ -196,14 +210,24 @@ namespace PeterDB {
         fileHandle.recordLength = slot.length;
         std::memcpy(fileHandle.recordBuffer, (char *) fileHandle.pageBuffer + slot.offset, fileHandle.recordLength);
         if (!recursive) return 0;
-        unsigned char c = 0;
-        if (std::memcmp(fileHandle.recordBuffer, &c, 1) == 0) return 0;
         RID recordID;
-        std::memcpy(&recordID.pageNum, (char *) fileHandle.recordBuffer + 1, sizeof(unsigned));
-        std::memcpy(&recordID.slotNum, (char *) fileHandle.recordBuffer + 1 + sizeof(unsigned), sizeof(unsigned short));
+        if (!getForwardRID(fileHandle, recordID)) return 0;
         return getRecordBuffer(fileHandle, recordID, true);
     }
 
+    unsigned char RecordBasedFileManager::getRecordFlag(FileHandle &fileHandle) {
+        unsigned char flag;
+        std::memcpy(&flag, fileHandle.recordBuffer, sizeof(unsigned char));
+        return flag;
+    }
+
+    bool RecordBasedFileManager::getForwardRID(FileHandle &fileHandle, RID &rid) {
+        if (getRecordFlag(fileHandle) != RECORD_TOMBSTONE) return false;
+        std::memcpy(&rid.pageNum, (char *) fileHandle.recordBuffer + 1, sizeof(unsigned));
+        std::memcpy(&rid.slotNum, (char *) fileHandle.recordBuffer + 1 + sizeof(unsigned), sizeof(unsigned short));
+        return true;
+    }
+
     RC RecordBasedFileManager::toData(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor, void *data) {
         unsigned numberOfAttributes = recordDescriptor.size();
         unsigned numberOfNullBytes = numberOfAttributes % 8 == 0 ? numberOfAttributes / 8 : numberOfAttributes / 8 + 1;
@@ -341,19 +365,25 @@ namespace PeterDB {
         slot.offset = -1;
         std::memcpy((char *) fileHandle.pageBuffer + PAGE_SIZE - 2 * sizeof(unsigned short) - (rid.slotNum + 1) * sizeof(Slot), &slot, sizeof(Slot));
         if (rid.slotNum == getNumberOfSlot(fileHandle) - 1) std::memcpy((char *) fileHandle.pageBuffer + PAGE_SIZE - 2 * sizeof(unsigned short), &rid.slotNum, sizeof(unsigned short));
-        rc = fileHandle.writePage(rid.pageNum, fileHandle.pageBuffer);
+        rc = writePageBuffer(fileHandle, rid.pageNum);
         if (rc != 0) return rc;
-        unsigned char c = 0;
-        if (std::memcmp(fileHandle.recordBuffer, &c, 1) == 0) return 0;
         RID recordID;
-        std::memcpy(&recordID.pageNum, (char *) fileHandle.recordBuffer + 1, sizeof(unsigned));
-        std::memcpy(&recordID.slotNum, (char *) fileHandle.recordBuffer + 1 + sizeof(unsigned), sizeof(unsigned short));
+        if (!getForwardRID(fileHandle, recordID)) return 0;
         return deleteRecord(fileHandle, recordDescriptor, recordID);
     }
 
     RC RecordBasedFileManager::updateRecord(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor,
                                             const void *data, const RID &rid) {
-        RC rc = toRecordBuffer(fileHandle, recordDescriptor, data);
+        // Release the record a tombstone points to, the tombstone itself is rewritten below
+        RC rc = getRecordBuffer(fileHandle, rid, false);
+        if (rc != 0) return rc;
+        RID recordID;
+        if (getForwardRID(fileHandle, recordID)) {
+            rc = deleteRecord(fileHandle, recordDescriptor, recordID);
+            if (rc != 0) return rc;
+        }
+
+        rc = toRecordBuffer(fileHandle, recordDescriptor, data);
         if (rc != 0) return rc;
         rc = getPageBuffer(fileHandle, rid.pageNum);
         if (rc != 0) return rc;
@@ -367,7 +397,7 @@ namespace PeterDB {
             shiftLeft(fileHandle, slot.offset + fileHandle.recordLength, slot.length - fileHandle.recordLength);
             slot.length = fileHandle.recordLength;
             writeSlot(fileHandle, slot, rid.slotNum);
-            return fileHandle.writePage(rid.pageNum, fileHandle.pageBuffer);
+            return writePageBuffer(fileHandle, rid.pageNum);
         } else if (fileHandle.recordLength - slot.length <= freeSpace) {
             shiftLeft(fileHandle, slot.offset, slot.length);
             unsigned short startOfFreeSpace = getStartOfFreeSpace(fileHandle);
@@ -377,21 +407,22 @@ namespace PeterDB {
             writeSlot(fileHandle, slot, rid.slotNum);
             startOfFreeSpace = startOfFreeSpace + fileHandle.recordLength;
             std::memcpy((char *) fileHandle.pageBuffer + PAGE_SIZE - sizeof(unsigned short), &startOfFreeSpace, sizeof(unsigned short));
-            return fileHandle.writePage(rid.pageNum, fileHandle.pageBuffer);
+            return writePageBuffer(fileHandle, rid.pageNum);
         } else {
-            RID recordID;
-            rc = insertRecord(fileHandle, recordDescriptor, data, recordID);
+            unsigned char flag = RECORD_MOVED;
+            std::memcpy(fileHandle.recordBuffer, &flag, sizeof(unsigned char));
+            rc = insertRecordBuffer(fileHandle, recordID);
             if (rc != 0) return rc;
             rc = getPageBuffer(fileHandle, rid.pageNum);
             if (rc != 0) return rc;
-            unsigned char c = 1;
+            unsigned char c = RECORD_TOMBSTONE;
             std::memcpy((char *) fileHandle.pageBuffer + slot.offset, &c, sizeof(unsigned char));
             std::memcpy((char *) fileHandle.pageBuffer + slot.offset + sizeof(unsigned char), &recordID.pageNum, sizeof(unsigned));
             std::memcpy((char *) fileHandle.pageBuffer + slot.offset + sizeof(unsigned char) + sizeof(unsigned), &recordID.slotNum, sizeof(unsigned short));
             shiftLeft(fileHandle, slot.offset + 7, slot.length - 7);
             slot.length = 7;
             writeSlot(fileHandle, slot, rid.slotNum);
-            return fileHandle.writePage(rid.pageNum, fileHandle.pageBuffer);
+            return writePageBuffer(fileHandle, rid.pageNum);
         }
     }
 
@@ -435,149 +466,332 @@ namespace PeterDB {
                                     const std::string &conditionAttribute, const CompOp compOp, const void *value,
                                     const std::vector<std::string> &attributeNames,
                                     RBFM_ScanIterator &rbfm_ScanIterator) {
-        rbfm_ScanIterator.fileHandle = fileHandle;
-        rbfm_ScanIterator.rids = std::vector<RID>();
-        rbfm_ScanIterator.pos = 0;
+        std::vector<ScanCondition> conditions;
+        if (!conditionAttribute.empty()) conditions.emplace_back(conditionAttribute, compOp, value);
+        return scan(fileHandle, recordDescriptor, conditions, attributeNames, rbfm_ScanIterator);
+    }
+
+    RC RecordBasedFileManager::scan(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor,
+                                    const std::vector<ScanCondition> &conditions,
+                                    const std::vector<std::string> &attributeNames,
+                                    RBFM_ScanIterator &rbfm_ScanIterator) {
+        std::vector<std::vector<ScanCondition>> disjunction;
+        if (!conditions.empty()) disjunction.push_back(conditions);
+        return scan(fileHandle, recordDescriptor, disjunction, attributeNames, rbfm_ScanIterator);
+    }
+
+    RC RecordBasedFileManager::scan(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor,
+                                    const std::vector<std::vector<ScanCondition>> &disjunction,
+                                    const std::vector<std::string> &attributeNames,
+                                    RBFM_ScanIterator &rbfm_ScanIterator) {
+        // The scan reads through a handle of its own, so the caller may keep writing, remap or close its handle.
+        // Pages the caller appended may not be in the header on disk yet, the private handle takes its page count
+        if (&fileHandle != &rbfm_ScanIterator.fileHandle) {
+            RC rc = rbfm_ScanIterator.fileHandle.closeFile();
+            if (rc != 0) return rc;
+            rc = PagedFileManager::instance().openFile(fileHandle.fileName, rbfm_ScanIterator.fileHandle,
+                                                       fileHandle.isMapped());
+            if (rc != 0) return rc;
+            FileHandle &scanHandle = rbfm_ScanIterator.fileHandle;
+            if (scanHandle.numberOfPages < fileHandle.numberOfPages) {
+                scanHandle.numberOfPages = fileHandle.numberOfPages;
+                if (scanHandle.isMapped()) {
+                    rc = scanHandle.unmapFile();
+                    if (rc != 0) return rc;
+                    rc = scanHandle.mapFile();
+                    if (rc != 0) return rc;
+                }
+            }
+        }
+        // Scanned pages are read once, keep them from evicting the pages point lookups depend on
+        rbfm_ScanIterator.fileHandle.sequential = true;
+        rbfm_ScanIterator.cursor = RID(0, 0);
+        rbfm_ScanIterator.endPageNum = UINT_MAX;
         rbfm_ScanIterator.recordDescriptor = recordDescriptor;
         rbfm_ScanIterator.attributeNames = attributeNames;
-
-        Attribute attr;
-        for (const auto &attrDescriptor: recordDescriptor) {
-            if (attrDescriptor.name == conditionAttribute) {
-                attr = attrDescriptor;
+        rbfm_ScanIterator.projection = std::vector<int>(attributeNames.size(), -1);
+        for (unsigned index = 0; index < attributeNames.size(); index++) {
+            for (unsigned indexOfAttribute = 0; indexOfAttribute < recordDescriptor.size(); indexOfAttribute++) {
+                if (recordDescriptor[indexOfAttribute].name != attributeNames[index]) continue;
+                rbfm_ScanIterator.projection[index] = indexOfAttribute;
                 break;
             }
         }
+        rbfm_ScanIterator.fieldStarts = std::vector<unsigned short>(recordDescriptor.size());
+        rbfm_ScanIterator.fieldEnds = std::vector<unsigned short>(recordDescriptor.size());
+        rbfm_ScanIterator.predicates.clear();
+        for (const auto &conjunction: disjunction) {
+            std::vector<Predicate> predicates(conjunction.size());
+            for (unsigned index = 0; index < conjunction.size(); index++) {
+                const ScanCondition &condition = conjunction[index];
+                RC rc = predicates[index].compile(recordDescriptor, condition.attribute, condition.compOp, condition.value);
+                if (rc != 0) return rc;
+            }
+            rbfm_ScanIterator.predicates.push_back(predicates);
+        }
+        return 0;
+    }
+
+    template<typename T>
+    static int compareNumber(const char *field, unsigned short, const char *value, unsigned short) {
+        T fieldValue, conditionValue;
+        std::memcpy(&fieldValue, field, sizeof(T));
+        std::memcpy(&conditionValue, value, sizeof(T));
+        return (fieldValue > conditionValue) - (fieldValue < conditionValue);
+    }
+
+    static int compareVarChar(const char *field, unsigned short fieldLength, const char *value, unsigned short valueLength) {
+        int cmp = std::memcmp(field, value, std::min(fieldLength, valueLength));
+        if (cmp != 0) return cmp;
+        return (fieldLength > valueLength) - (fieldLength < valueLength);
+    }
+
+    template<int (*compare)(const char *, unsigned short, const char *, unsigned short), CompOp compOp>
+    static bool compareWith(const char *field, unsigned short fieldLength, const char *value, unsigned short valueLength) {
+        int cmp = compare(field, fieldLength, value, valueLength);
+        switch (compOp) {
+            case EQ_OP: return cmp == 0;
+            case LT_OP: return cmp < 0;
+            case LE_OP: return cmp <= 0;
+            case GT_OP: return cmp > 0;
+            case GE_OP: return cmp >= 0;
+            case NE_OP: return cmp != 0;
+            default: return true;
+        }
+    }
 
-        int intBuffer, intValue, lengthBuffer, length;
-        float floatBuffer, floatValue;
-        char *varCharBuffer = nullptr, *varChar = nullptr;
-        unsigned char c = 0;
-        bool mark;
-        unsigned numberOfPages = fileHandle.getNumberOfPages();
-        for (unsigned pageNum = 0; pageNum < numberOfPages; pageNum = pageNum + 1) {
-            getPageBuffer(fileHandle, pageNum);
-            unsigned short numberOfSlots = getNumberOfSlot(fileHandle);
-            for (unsigned short slotNum = 0; slotNum < numberOfSlots; slotNum = slotNum + 1) {
-                Slot slot;
-                getSlot(fileHandle, slot, slotNum);
-                if (slot.offset == -1) continue;
-                RID rid(pageNum, slotNum);
-                if (conditionAttribute.empty()) {
-                    rbfm_ScanIterator.rids.push_back(rid);
-                    continue;
-                }
-                getRecordBuffer(fileHandle, rid, false);
-                if (std::memcmp(fileHandle.recordBuffer, &c, 1) != 0) continue;
-                char data[1 + sizeof(int) + attr.length];
-                std::memset(data, 0, 1 + sizeof(int) + attr.length);
-                readAttribute(fileHandle, recordDescriptor, rid, conditionAttribute, data);
-                if (std::memcmp(data, &c, 1) != 0) continue;
-                if (compOp == NO_OP) {
-                    rbfm_ScanIterator.rids.push_back(rid);
-                    continue;
-                }
-                switch (attr.type) {
-                    case 0:
-                        std::memcpy(&intBuffer, data + 1, sizeof(int));
-                        std::memcpy(&intValue, value, sizeof(int));
-                        break;
-                    case 1:
-                        std::memcpy(&floatBuffer, data + 1, sizeof(float));
-                        std::memcpy(&floatValue, value, sizeof(float));
-                        break;
-                    default:
-                        std::memcpy(&lengthBuffer, data + 1, sizeof(int));
-                        std::memcpy(&length, value, sizeof(int));
-                        delete[] varCharBuffer;
-                        varCharBuffer = nullptr;
-                        varCharBuffer = new char[lengthBuffer + 1];
-                        std::memset(varCharBuffer, 0, lengthBuffer + 1);
-                        std::memcpy(varCharBuffer, data + 1 + sizeof(int), lengthBuffer);
-                        delete[] varChar;
-                        varChar = nullptr;
-                        varChar = new char[length + 1];
-                        std::memset(varChar, 0, length + 1);
-                        std::memcpy(varChar, (char *) value + sizeof(int), length);
-                }
-                switch (compOp) {
-                    case 0:
-                        if (attr.type == 0) mark = intBuffer == intValue;
-                        else if (attr.type == 1) mark = floatBuffer == floatValue;
-                        else mark = std::strcmp(varCharBuffer, varChar) == 0;
-                        break;
-                    case 1:
-                        if (attr.type == 0) mark = intBuffer < intValue;
-                        else if (attr.type == 1) mark = floatBuffer < floatValue;
-                        else mark = std::strcmp(varCharBuffer, varChar) < 0;
-                        break;
-                    case 2:
-                        if (attr.type == 0) mark = intBuffer <= intValue;
-                        else if (attr.type == 1) mark = floatBuffer <= floatValue;
-                        else mark = std::strcmp(varCharBuffer, varChar) <= 0;
-                        break;
-                    case 3:
-                        if (attr.type == 0) mark = intBuffer > intValue;
-                        else if (attr.type == 1) mark = floatBuffer > floatValue;
-                        else mark = std::strcmp(varCharBuffer, varChar) > 0;
-                        break;
-                    case 4:
-                        if (attr.type == 0) mark = intBuffer >= intValue;
-                        else if (attr.type == 1) mark = floatBuffer >= floatValue;
-                        else mark = std::strcmp(varCharBuffer, varChar) >= 0;
-                        break;
-                    case 5:
-                        if (attr.type == 0) mark = intBuffer != intValue;
-                        else if (attr.type == 1) mark = floatBuffer != floatValue;
-                        else mark = std::strcmp(varCharBuffer, varChar) != 0;
-                        break;
-                    default:
-                        mark = true;
-                }
-                if (mark) rbfm_ScanIterator.rids.push_back(rid);
+    template<int (*compare)(const char *, unsigned short, const char *, unsigned short)>
+    static FieldComparator getComparator(CompOp compOp) {
+        switch (compOp) {
+            case EQ_OP: return compareWith<compare, EQ_OP>;
+            case LT_OP: return compareWith<compare, LT_OP>;
+            case LE_OP: return compareWith<compare, LE_OP>;
+            case GT_OP: return compareWith<compare, GT_OP>;
+            case GE_OP: return compareWith<compare, GE_OP>;
+            case NE_OP: return compareWith<compare, NE_OP>;
+            default: return nullptr;
+        }
+    }
+
+    RC Predicate::compile(const std::vector<Attribute> &recordDescriptor, const std::string &conditionAttribute, CompOp compOp,
+                          const void *value) {
+        attrIndex = -1;
+        unsatisfiable = false;
+        comparator = nullptr;
+        this->value.clear();
+        if (conditionAttribute.empty()) return 0;
+        for (unsigned index = 0; index < recordDescriptor.size(); index++) {
+            if (recordDescriptor[index].name == conditionAttribute) {
+                attrIndex = index;
+                break;
             }
         }
-        delete[] varCharBuffer;
-        delete[] varChar;
+        if (attrIndex < 0) {
+            unsatisfiable = true;
+            return 0;
+        }
+        if (compOp == NO_OP || value == nullptr) return 0;
+
+        const Attribute &attr = recordDescriptor[attrIndex];
+        if (attr.type == TypeInt) {
+            comparator = getComparator<compareNumber<int>>(compOp);
+            this->value.assign((const char *) value, (const char *) value + sizeof(int));
+        } else if (attr.type == TypeReal) {
+            comparator = getComparator<compareNumber<float>>(compOp);
+            this->value.assign((const char *) value, (const char *) value + sizeof(float));
+        } else if (attr.type == TypeVarChar) {
+            int length;
+            std::memcpy(&length, value, sizeof(int));
+            comparator = getComparator<compareVarChar>(compOp);
+            this->value.assign((const char *) value + sizeof(int), (const char *) value + sizeof(int) + length);
+        } else return ERR_ATTRIBUTE_TYPE_UNDEFINED;
         return 0;
     }
 
+    bool Predicate::evaluate(const char *recordBuffer, const std::vector<unsigned short> &fieldStarts,
+                             const std::vector<unsigned short> &fieldEnds) const {
+        if (unsatisfiable) return false;
+        if (attrIndex < 0) return true;
+        if (fieldEnds[attrIndex] == 0) return false;
+        if (comparator == nullptr) return true;
+        return comparator(recordBuffer + fieldStarts[attrIndex], fieldEnds[attrIndex] - fieldStarts[attrIndex],
+                          value.data(), value.size());
+    }
+
     RC RBFM_ScanIterator::getNextRecord(RID &rid, void *data) {
-        if (pos >= rids.size()) return RBFM_EOF;
-        rid = rids[pos];
-        int attrsLength = attributeNames.size();
+        RecordBasedFileManager &rbfm = RecordBasedFileManager::instance();
+        while (true) {
+            if (fileHandle.pFile == nullptr || cursor.pageNum >= fileHandle.getNumberOfPages() || cursor.pageNum >= endPageNum) return RBFM_EOF;
+            rbfm.getPageBuffer(fileHandle, cursor.pageNum);
+            if (cursor.slotNum >= rbfm.getNumberOfSlot(fileHandle)) {
+                cursor.pageNum = cursor.pageNum + 1;
+                cursor.slotNum = 0;
+                continue;
+            }
+            rid = cursor;
+            cursor.slotNum = cursor.slotNum + 1;
+            Slot slot;
+            rbfm.getSlot(fileHandle, slot, rid.slotNum);
+            if (slot.offset == -1) continue;
+            rbfm.getRecordBuffer(fileHandle, rid, false);
+            if (rbfm.getRecordFlag(fileHandle) == RECORD_MOVED) continue;
+            RID recordID;
+            if (rbfm.getForwardRID(fileHandle, recordID) && rbfm.getRecordBuffer(fileHandle, recordID, true) != 0) continue;
+            decodeFields();
+            if (isMatch()) break;
+        }
+
+        int attrsLength = projection.size();
         int bitmapBytes = attrsLength % 8 ? attrsLength / 8 + 1 : attrsLength / 8;
         char bitmaps[bitmapBytes];
         std::memset(bitmaps, 0, bitmapBytes);
         int offset = bitmapBytes;
         for (int index = 0; index < attrsLength; index = index + 1) {
-            const std::string &attributeName = attributeNames[index];
-            for (const Attribute &attr : recordDescriptor) {
-                if (attr.name == attributeName) {
-                    char dataBuffer[1 + sizeof(int) + attr.length];
-                    RecordBasedFileManager::instance().readAttribute(fileHandle, recordDescriptor, rid, attr.name, dataBuffer);
-                    if (dataBuffer[0] >> 7 & (unsigned) 1) bitmaps[index / 8] |= (unsigned) 1 << (7 - index % 8);
-                    else if (attr.type == 2) {
-                        int length;
-                        std::memcpy(&length, dataBuffer + 1, sizeof(int));
-                        std::memcpy((char *) data + offset, dataBuffer + 1, sizeof(int) + length);
-                        offset = offset + sizeof(int) + length;
-                    } else {
-                        std::memcpy((char *) data + offset, dataBuffer + 1, sizeof(int));
-                        offset = offset + sizeof(int);
-                    }
-                    break;
-                }
+            int indexOfAttribute = projection[index];
+            if (indexOfAttribute < 0 || fieldEnds[indexOfAttribute] == 0) {
+                bitmaps[index / 8] |= (unsigned) 1 << (7 - index % 8);
+                continue;
             }
+            int length = fieldEnds[indexOfAttribute] - fieldStarts[indexOfAttribute];
+            if (recordDescriptor[indexOfAttribute].type == TypeVarChar) {
+                std::memcpy((char *) data + offset, &length, sizeof(int));
+                offset = offset + sizeof(int);
+            }
+            std::memcpy((char *) data + offset, (char *) fileHandle.recordBuffer + fieldStarts[indexOfAttribute], length);
+            offset = offset + length;
         }
         std::memcpy(data, bitmaps, bitmapBytes);
-        pos = pos + 1;
+        recordSize = offset;
         return 0;
     }
 
+    bool RBFM_ScanIterator::isMatch() {
+        if (predicates.empty()) return true;
+        for (const auto &conjunction: predicates) {
+            bool match = true;
+            for (const Predicate &predicate: conjunction) {
+                if (!predicate.evaluate((const char *) fileHandle.recordBuffer, fieldStarts, fieldEnds)) {
+                    match = false;
+                    break;
+                }
+            }
+            if (match) return true;
+        }
+        return false;
+    }
+
+    void RBFM_ScanIterator::decodeFields() {
+        unsigned numberOfAttributes = recordDescriptor.size();
+        unsigned short prev = 1 + sizeof(unsigned) + (numberOfAttributes + 1) * sizeof(unsigned short);
+        unsigned short offset;
+        for (unsigned indexOfAttribute = 0; indexOfAttribute < numberOfAttributes; indexOfAttribute++) {
+            std::memcpy(&offset, (char *) fileHandle.recordBuffer + 1 + sizeof(unsigned) + (1 + indexOfAttribute) * sizeof(unsigned short), sizeof(unsigned short));
+            fieldStarts[indexOfAttribute] = prev;
+            fieldEnds[indexOfAttribute] = offset;
+            if (offset != 0) prev = offset;
+        }
+    }
+
     RC RBFM_ScanIterator::close() {
-        fileHandle.closeFile();
-        rids.clear();
+        return fileHandle.closeFile();
+    }
+
+    RC RecordBasedFileManager::parallelScan(const std::string &fileName, const std::vector<Attribute> &recordDescriptor,
+                                            const std::vector<std::vector<ScanCondition>> &disjunction,
+                                            const std::vector<std::string> &attributeNames, unsigned numberOfWorkers,
+                                            RBFM_ParallelScanIterator &rbfm_ParallelScanIterator) {
+        rbfm_ParallelScanIterator.close();
+        if (numberOfWorkers == 0) numberOfWorkers = 1;
+
+        // Handles are opened here so that worker threads never touch the buffer pool, only their own mappings
+        RC rc;
+        rbfm_ParallelScanIterator.scanIterators = std::vector<RBFM_ScanIterator>(numberOfWorkers);
+        for (RBFM_ScanIterator &scanIterator : rbfm_ParallelScanIterator.scanIterators) {
+            rc = openFile(fileName, scanIterator.fileHandle, true);
+            if (rc == 0) rc = scan(scanIterator.fileHandle, recordDescriptor, disjunction, attributeNames, scanIterator);
+            if (rc != 0) {
+                rbfm_ParallelScanIterator.close();
+                return rc;
+            }
+        }
+
+        unsigned dataSize = (attributeNames.size() + 7) / 8;
+        for (const Attribute &attr : recordDescriptor) dataSize = dataSize + sizeof(int) + attr.length;
+
+        rbfm_ParallelScanIterator.numberOfPages = rbfm_ParallelScanIterator.scanIterators[0].fileHandle.getNumberOfPages();
+        rbfm_ParallelScanIterator.nextPageNum = 0;
+        rbfm_ParallelScanIterator.stopped = false;
+        rbfm_ParallelScanIterator.runningWorkers = numberOfWorkers;
+        for (unsigned workerIndex = 0; workerIndex < numberOfWorkers; workerIndex++) {
+            rbfm_ParallelScanIterator.workers.emplace_back(&RBFM_ParallelScanIterator::work, &rbfm_ParallelScanIterator, workerIndex, dataSize);
+        }
+        return 0;
+    }
+
+    RBFM_ParallelScanIterator::~RBFM_ParallelScanIterator() {
+        close();
+    }
+
+    void RBFM_ParallelScanIterator::work(unsigned workerIndex, unsigned dataSize) {
+        RBFM_ScanIterator &scanIterator = scanIterators[workerIndex];
+        RID rid;
+        while (true) {
+            unsigned pageNum = nextPageNum.fetch_add(PARALLEL_SCAN_MORSEL_SIZE);
+            if (pageNum >= numberOfPages) break;
+            scanIterator.cursor = RID(pageNum, 0);
+            scanIterator.endPageNum = pageNum + PARALLEL_SCAN_MORSEL_SIZE;
+            Batch batch;
+            batch.data.resize(dataSize);
+            while (scanIterator.getNextRecord(rid, batch.data.data() + batch.data.size() - dataSize) == 0) {
+                unsigned end = batch.data.size() - dataSize + scanIterator.recordSize;
+                batch.rows.emplace_back(rid, end);
+                batch.data.resize(end + dataSize);
+            }
+            if (batch.rows.empty()) continue;
+            batch.data.resize(batch.rows.back().second);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this] { return stopped || batches.size() < PARALLEL_SCAN_QUEUE_SIZE; });
+            if (stopped) break;
+            batches.push_back(std::move(batch));
+            notEmpty.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        runningWorkers = runningWorkers - 1;
+        notEmpty.notify_all();
+    }
+
+    RC RBFM_ParallelScanIterator::getNextRecord(RID &rid, void *data) {
+        if (currentRow == current.rows.size()) {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this] { return !batches.empty() || runningWorkers == 0; });
+            if (batches.empty()) return RBFM_EOF;
+            current = std::move(batches.front());
+            batches.pop_front();
+            currentRow = 0;
+            notFull.notify_one();
+        }
+        unsigned start = currentRow == 0 ? 0 : current.rows[currentRow - 1].second;
+        rid = current.rows[currentRow].first;
+        std::memcpy(data, current.data.data() + start, current.rows[currentRow].second - start);
+        currentRow = currentRow + 1;
+        return 0;
+    }
+
+    RC RBFM_ParallelScanIterator::close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+            notFull.notify_all();
+        }
+        for (std::thread &worker : workers) worker.join();
+        workers.clear();
+        for (RBFM_ScanIterator &scanIterator : scanIterators) scanIterator.close();
+        scanIterators.clear();
+        batches.clear();
+        current = Batch();
+        currentRow = 0;
+        runningWorkers = 0;
         return 0;
     }
 
@@ -1,5 +1,6 @@
 #include "src/include/rm.h"
 #include <iostream>
+#include <algorithm>
 
 namespace PeterDB {
     RelationManager &RelationManager::instance() {
@@ -8,6 +9,8 @@ namespace PeterDB {
     }
 
     RelationManager::RelationManager() {
+        // Constructed first so the buffer pool outlives the table handles closed on destruction
+        PagedFileManager::instance();
         tableIdBuffer = malloc(5);
         std::memset(tableIdBuffer, 0, 5);
         attributesBuffer = malloc(75);
@@ -19,6 +22,7 @@ namespace PeterDB {
     }
 
     RelationManager::~RelationManager() {
+        closeTables();
         free(tableIdBuffer);
         free(attributesBuffer);
         free(positionBuffer);
@@ -65,6 +69,7 @@ namespace PeterDB {
     }
 
     bool RelationManager::checkTableExists(const std::string &tableName) {
+        if (tableHandles.find(tableName) != tableHandles.end()) return true;
         FileHandle fileHandle;
         RC rc = rbfm.openFile(getFileName(tableName), fileHandle);
         rbfm.closeFile(fileHandle);
@@ -131,7 +136,118 @@ namespace PeterDB {
         return rc;
     }
 
+    void RelationManager::invalidateCatalog(const std::string &tableName) {
+        catalogCache.erase(tableName);
+    }
+
+    RC RelationManager::openTable(const std::string &tableName, FileHandle *&fileHandle) {
+        auto it = tableHandles.find(tableName);
+        if (it == tableHandles.end()) {
+            TableHandle *tableHandle = new TableHandle();
+            RC rc = rbfm.openFile(getFileName(tableName), tableHandle->fileHandle);
+            if (rc != 0) {
+                delete tableHandle;
+                return rc;
+            }
+            openDescriptors = openDescriptors + 1;
+            tableHandle->lruPos = tableHandleLru.insert(tableHandleLru.end(), tableName);
+            it = tableHandles.emplace(tableName, tableHandle).first;
+        } else tableHandleLru.splice(tableHandleLru.end(), tableHandleLru, it->second->lruPos);
+        it->second->refCount = it->second->refCount + 1;
+        fileHandle = &it->second->fileHandle;
+        evictTables();
+        return 0;
+    }
+
+    void RelationManager::releaseTable(const std::string &tableName) {
+        auto it = tableHandles.find(tableName);
+        if (it == tableHandles.end() || it->second->refCount == 0) return;
+        it->second->refCount = it->second->refCount - 1;
+    }
+
+    RC RelationManager::openIndex(const std::string &tableName, int columnPosition, IXFileHandle *&ixFileHandle) {
+        auto it = tableHandles.find(tableName);
+        if (it == tableHandles.end()) return ERR_TABLE_NOT_EXISTS;
+        TableHandle *tableHandle = it->second;
+        auto indexIt = tableHandle->ixFileHandles.find(columnPosition);
+        if (indexIt == tableHandle->ixFileHandles.end()) {
+            IXFileHandle *indexHandle = new IXFileHandle();
+            RC rc = ix.openFile(getIndexFileName(tableName, columnPosition), *indexHandle);
+            if (rc != 0) {
+                delete indexHandle;
+                return rc;
+            }
+            openDescriptors = openDescriptors + 1;
+            indexIt = tableHandle->ixFileHandles.emplace(columnPosition, indexHandle).first;
+            evictTables();
+        }
+        ixFileHandle = indexIt->second;
+        return 0;
+    }
+
+    RC RelationManager::syncTable(const std::string &tableName) {
+        auto it = tableHandles.find(tableName);
+        if (it == tableHandles.end()) return 0;
+        RC rc = it->second->fileHandle.flush();
+        if (rc != 0) return rc;
+        for (const std::pair<const int, IXFileHandle *> &index : it->second->ixFileHandles) {
+            rc = index.second->fileHandle.flush();
+            if (rc != 0) return rc;
+        }
+        return 0;
+    }
+
+    RC RelationManager::closeIndex(const std::string &tableName, int columnPosition) {
+        auto it = tableHandles.find(tableName);
+        if (it == tableHandles.end()) return 0;
+        auto indexIt = it->second->ixFileHandles.find(columnPosition);
+        if (indexIt == it->second->ixFileHandles.end()) return 0;
+        RC rc = ix.closeFile(*indexIt->second);
+        delete indexIt->second;
+        it->second->ixFileHandles.erase(indexIt);
+        openDescriptors = openDescriptors - 1;
+        return rc;
+    }
+
+    RC RelationManager::closeTable(const std::string &tableName) {
+        auto it = tableHandles.find(tableName);
+        if (it == tableHandles.end()) return 0;
+        TableHandle *tableHandle = it->second;
+        RC rc = 0;
+        for (const std::pair<const int, IXFileHandle *> &index : tableHandle->ixFileHandles) {
+            if (ix.closeFile(*index.second) != 0) rc = ERR_FILE_CLOSE_FAILED;
+            delete index.second;
+        }
+        openDescriptors = openDescriptors - tableHandle->ixFileHandles.size() - 1;
+        if (rbfm.closeFile(tableHandle->fileHandle) != 0) rc = ERR_FILE_CLOSE_FAILED;
+        tableHandleLru.erase(tableHandle->lruPos);
+        tableHandles.erase(it);
+        delete tableHandle;
+        return rc;
+    }
+
+    RC RelationManager::closeTables() {
+        RC rc = 0;
+        while (!tableHandles.empty()) {
+            std::string tableName = tableHandles.begin()->first;
+            if (closeTable(tableName) != 0) rc = ERR_FILE_CLOSE_FAILED;
+        }
+        return rc;
+    }
+
+    // Handles still held by a caller are skipped even if the cap stays exceeded
+    void RelationManager::evictTables() {
+        auto lruIt = tableHandleLru.begin();
+        while (openDescriptors > TABLE_HANDLE_CACHE_SIZE && lruIt != tableHandleLru.end()) {
+            std::string tableName = *lruIt;
+            lruIt++;
+            if (tableHandles[tableName]->refCount == 0) closeTable(tableName);
+        }
+    }
+
     RC RelationManager::createCatalog() {
+        catalogCache.clear();
+        closeTables();
         RC rc = rbfm.createFile(tablesName);
         if (rc != 0) return rc;
         rc = rbfm.createFile(columnsName);
@@ -160,6 +276,8 @@ namespace PeterDB {
     }
 
     RC RelationManager::deleteCatalog() {
+        catalogCache.clear();
+        closeTables();
         RC rc = rbfm.destroyFile(tablesName);
         if (rc != 0) return rc;
         rc = rbfm.destroyFile(columnsName);
@@ -170,6 +288,8 @@ namespace PeterDB {
     }
 
     int RelationManager::getTableId(const std::string &tableName) {
+        auto it = catalogCache.find(tableName);
+        if (it != catalogCache.end()) return it->second.tableId;
         RM_ScanIterator rm_ScanIterator;
         std::vector<std::string> attributeNames = {"table-id"};
         int tableNameLength = tableName.size();
@@ -179,9 +299,10 @@ namespace PeterDB {
         scan(tablesName, "table-name", EQ_OP, tableNameBuffer, attributeNames, rm_ScanIterator);
         RID rid;
         int tableId;
-        rm_ScanIterator.getNextTuple(rid, tableIdBuffer);
+        RC rc = rm_ScanIterator.getNextTuple(rid, tableIdBuffer);
         std::memcpy(&tableId, (char *) tableIdBuffer + 1, sizeof(int));
         rm_ScanIterator.close();
+        if (rc == 0) catalogCache[tableName].tableId = tableId;
         return tableId;
     }
 
@@ -220,6 +341,8 @@ namespace PeterDB {
     RC RelationManager::createTable(const std::string &tableName, const std::vector<Attribute> &attrs) {
         if (!checkTableExists(tablesName)) return ERR_CATALOG_NOT_EXISTS;
         if (checkTableExists(tableName)) return ERR_TABLE_NAME_EXISTS;
+        if (tableName.compare(0, strlen(TEMP_FILE_PREFIX), TEMP_FILE_PREFIX) == 0) return ERR_TABLE_NAME_RESERVED;
+        invalidateCatalog(tableName);
 
         FileHandle tablesHandle, columnsHandle;
         rbfm.openFile(tablesName, tablesHandle);
@@ -249,6 +372,7 @@ namespace PeterDB {
         rm_ScanIterator.close();
         if (rc != 0) return rc;
         deleteFromSystemFiles(tablesName, rid);
+        closeTable(tableName);
 
         std::vector<RID> toBeDeleted;
         scan(columnsName, "table-id", EQ_OP, &tableId, attributeNames, rm_ScanIterator);
@@ -267,12 +391,23 @@ namespace PeterDB {
         rm_ScanIterator.close();
         for (const RID &ridBuffer : toBeDeleted) deleteFromSystemFiles(indexesName, ridBuffer);
 
+        invalidateCatalog(tableName);
         return rbfm.destroyFile(getFileName(tableName));
     }
 
     RC
     RelationManager::getVersionedAttributes(const std::string &tableName, int targetVersion, std::vector<Attribute> &attrs, std::vector<int> &positions) {
         int tableId = getTableId(tableName);
+        auto it = catalogCache.find(tableName);
+        if (it != catalogCache.end()) {
+            auto versionIt = it->second.versions.find(targetVersion);
+            if (versionIt != it->second.versions.end()) {
+                attrs.insert(attrs.end(), versionIt->second.first.begin(), versionIt->second.first.end());
+                positions.insert(positions.end(), versionIt->second.second.begin(), versionIt->second.second.end());
+                return 0;
+            }
+        }
+
         RM_ScanIterator rm_ScanIterator;
         scan(columnsName, "table-id", EQ_OP, &tableId, getAttributeAttrs(), rm_ScanIterator);
 
@@ -281,6 +416,8 @@ namespace PeterDB {
         std::string name;
         AttrType type;
         AttrLength length;
+        std::vector<Attribute> versionAttrs;
+        std::vector<int> versionPositions;
         while (rm_ScanIterator.getNextTuple(rid, attributesBuffer) != RM_EOF) {
             std::memcpy(&attributeNameLength, (char *) attributesBuffer + 1 + sizeof(int), sizeof(int));
             std::memcpy(&version, (char *) attributesBuffer + 1 + 5 * sizeof(int) + attributeNameLength, sizeof(int));
@@ -292,12 +429,15 @@ namespace PeterDB {
             name = std::string(attributeName);
             std::memcpy(&type, (char *) attributesBuffer + 1 + 2 * sizeof(int) + attributeNameLength, sizeof(int));
             std::memcpy(&length, (char *) attributesBuffer + 1 + 3 * sizeof(int) + attributeNameLength, sizeof(int));
-            attrs.emplace_back(name, type, length);
-            positions.push_back(position);
+            versionAttrs.emplace_back(name, type, length);
+            versionPositions.push_back(position);
         }
 
         rm_ScanIterator.close();
 
+        attrs.insert(attrs.end(), versionAttrs.begin(), versionAttrs.end());
+        positions.insert(positions.end(), versionPositions.begin(), versionPositions.end());
+        if (it != catalogCache.end()) it->second.versions[targetVersion] = std::make_pair(versionAttrs, versionPositions);
         return 0;
     }
 
@@ -306,11 +446,12 @@ namespace PeterDB {
         if (tableName == tablesName) {attrs = getTablesAttrs(); return 0;}
         if (tableName == columnsName) {attrs = getColumnsAttrs(); return 0;}
         if (tableName == indexesName) {attrs = getIndexesAttrs(); return 0;}
-        FileHandle fileHandle;
-        rbfm.openFile(getFileName(tableName), fileHandle);
+        FileHandle *fileHandle;
+        RC rc = openTable(tableName, fileHandle);
+        if (rc != 0) return rc;
         std::vector<int> positions;
-        RC rc = getVersionedAttributes(tableName, fileHandle.version, attrs, positions);
-        rbfm.closeFile(fileHandle);
+        rc = getVersionedAttributes(tableName, fileHandle->version, attrs, positions);
+        releaseTable(tableName);
         return rc;
     }
 
@@ -319,27 +460,107 @@ namespace PeterDB {
         if (!checkTableExists(tableName)) return ERR_TABLE_NOT_EXISTS;
         std::vector<Attribute> attrs;
         std::vector<int> positions;
-        FileHandle fileHandle;
-        rbfm.openFile(getFileName(tableName), fileHandle);
-        getVersionedAttributes(tableName, fileHandle.version, attrs, positions);
-        RC rc = rbfm.insertRecord(fileHandle, attrs, data, rid);
-        rbfm.closeFile(fileHandle);
+        FileHandle *fileHandle;
+        RC rc = openTable(tableName, fileHandle);
+        if (rc != 0) return rc;
+        getVersionedAttributes(tableName, fileHandle->version, attrs, positions);
+        rc = rbfm.insertRecord(*fileHandle, attrs, data, rid);
+        releaseTable(tableName);
         if (rc != 0) return rc;
         return modifyIndex(tableName, data, rid, attrs, positions);
     }
 
+    RC RelationManager::insertTuples(const std::string &tableName, const std::vector<const void *> &batch, std::vector<RID> &rids) {
+        if (tableName == tablesName || tableName == columnsName || tableName == indexesName) return ERR_CATALOG_ILLEGAL_MODIFY;
+        if (!checkTableExists(tableName)) return ERR_TABLE_NOT_EXISTS;
+        std::vector<Attribute> attrs;
+        std::vector<int> positions;
+        FileHandle *fileHandle;
+        RC rc = openTable(tableName, fileHandle);
+        if (rc != 0) return rc;
+        getVersionedAttributes(tableName, fileHandle->version, attrs, positions);
+
+        rids.clear();
+        rids.reserve(batch.size());
+        RID rid;
+        for (const void *data : batch) {
+            rc = rbfm.insertRecord(*fileHandle, attrs, data, rid);
+            if (rc != 0) break;
+            rids.push_back(rid);
+        }
+
+        // Collect the keys of the stored tuples for every indexed attribute
+        int size = attrs.size();
+        std::vector<int> indexOfAttribute(size, -1), indexedAttributes;
+        RID ridBuffer;
+        for (int i = 0; i < size; i++) {
+            if (!hasIndexOn(tableName, positions[i], ridBuffer)) continue;
+            indexOfAttribute[i] = indexedAttributes.size();
+            indexedAttributes.push_back(i);
+        }
+        std::vector<std::vector<char>> keys(indexedAttributes.size());
+        std::vector<std::vector<std::pair<int, RID>>> entries(indexedAttributes.size());    // (offset in keys, rid)
+        int numberOfNullBytes = size % 8 == 0 ? size / 8 : size / 8 + 1;
+        for (unsigned tupleIndex = 0; tupleIndex < rids.size() && !indexedAttributes.empty(); tupleIndex++) {
+            const char *data = (const char *) batch[tupleIndex];
+            int offset = numberOfNullBytes;
+            for (int i = 0; i < size; i++) {
+                if (data[i / 8] >> (7 - i % 8) & (unsigned) 1) continue;
+                int keyLength;
+                if (attrs[i].type != 2) keyLength = 4;
+                else {
+                    std::memcpy(&keyLength, data + offset, sizeof(int));
+                    keyLength = keyLength + sizeof(int);
+                }
+                int index = indexOfAttribute[i];
+                if (index >= 0) {
+                    entries[index].emplace_back(keys[index].size(), rids[tupleIndex]);
+                    keys[index].insert(keys[index].end(), data + offset, data + offset + keyLength);
+                }
+                offset = offset + keyLength;
+            }
+        }
+
+        // Sorted keys descend to neighbouring leaves, so consecutive insertions touch the same pages.
+        // Every stored tuple goes into every index even after an error, so the table and its indexes stay in step
+        IXFileHandle *ixFileHandle;
+        RC indexRc;
+        for (unsigned index = 0; index < indexedAttributes.size(); index++) {
+            const Attribute &attr = attrs[indexedAttributes[index]];
+            const char *keyBuffer = keys[index].data();
+            std::sort(entries[index].begin(), entries[index].end(),
+                      [&](const std::pair<int, RID> &entry, const std::pair<int, RID> &other) {
+                          int cmp = ix.compareKey(keyBuffer + entry.first, keyBuffer + other.first, attr.type);
+                          if (cmp != 0) return cmp < 0;
+                          return ix.compareRID(entry.second, other.second) < 0;
+                      });
+            indexRc = openIndex(tableName, positions[indexedAttributes[index]], ixFileHandle);
+            if (indexRc != 0) {
+                if (rc == 0) rc = indexRc;
+                continue;
+            }
+            for (const std::pair<int, RID> &entry : entries[index]) {
+                indexRc = ix.insertEntry(*ixFileHandle, attr, keyBuffer + entry.first, entry.second);
+                if (indexRc != 0 && rc == 0) rc = indexRc;
+            }
+        }
+
+        releaseTable(tableName);
+        return rc;
+    }
+
     RC RelationManager::deleteTuple(const std::string &tableName, const RID &rid) {
         if (tableName == tablesName || tableName == columnsName || tableName == indexesName) return ERR_CATALOG_ILLEGAL_MODIFY;
         if (!checkTableExists(tableName)) return ERR_TABLE_NOT_EXISTS;
         std::vector<Attribute> attrs;
         std::vector<int> positions;
-        FileHandle fileHandle;
-        rbfm.openFile(getFileName(tableName), fileHandle);
-        getVersionedAttributes(tableName, fileHandle.version, attrs, positions);
+        FileHandle *fileHandle;
+        RC rc = openTable(tableName, fileHandle);
+        if (rc != 0) return rc;
+        getVersionedAttributes(tableName, fileHandle->version, attrs, positions);
         readTuple(tableName, rid, tupleBuffer);
-        rbfm.openFile(getFileName(tableName), fileHandle);
-        RC rc = rbfm.deleteRecord(fileHandle, attrs, rid);
-        rbfm.closeFile(fileHandle);
+        rc = rbfm.deleteRecord(*fileHandle, attrs, rid);
+        releaseTable(tableName);
         if (rc != 0) return rc;
         return modifyIndex(tableName, tupleBuffer, rid, attrs, positions, false);
     }
@@ -349,16 +570,15 @@ namespace PeterDB {
         if (!checkTableExists(tableName)) return ERR_TABLE_NOT_EXISTS;
         std::vector<Attribute> attrs;
         std::vector<int> positions;
-        FileHandle fileHandle;
-        rbfm.openFile(getFileName(tableName), fileHandle);
-        getVersionedAttributes(tableName, fileHandle.version, attrs, positions);
-
-        readTuple(tableName, rid, tupleBuffer);
-        RC rc = modifyIndex(tableName, tupleBuffer, rid, attrs, positions, false);
+        FileHandle *fileHandle;
+        RC rc = openTable(tableName, fileHandle);
         if (rc != 0) return rc;
+        getVersionedAttributes(tableName, fileHandle->version, attrs, positions);
 
-        rc = rbfm.updateRecord(fileHandle, attrs, data, rid);
-        rbfm.closeFile(fileHandle);
+        readTuple(tableName, rid, tupleBuffer);
+        rc = modifyIndex(tableName, tupleBuffer, rid, attrs, positions, false);
+        if (rc == 0) rc = rbfm.updateRecord(*fileHandle, attrs, data, rid);
+        releaseTable(tableName);
         if (rc != 0) return rc;
 
         return modifyIndex(tableName, data, rid, attrs, positions);
@@ -425,17 +645,18 @@ namespace PeterDB {
 
     RC RelationManager::readTuple(const std::string &tableName, const RID &rid, void *data) {
         if (!checkTableExists(tableName)) return ERR_TABLE_NOT_EXISTS;
-        FileHandle fileHandle;
-        rbfm.openFile(getFileName(tableName), fileHandle);
-        int version = fileHandle.version;
+        FileHandle *fileHandle;
+        RC rc = openTable(tableName, fileHandle);
+        if (rc != 0) return rc;
+        int version = fileHandle->version;
         std::vector<Attribute> attrs;
-        int recordVersion = rbfm.getRecordVersion(fileHandle, rid);
+        int recordVersion = rbfm.getRecordVersion(*fileHandle, rid);
         std::vector<int> positions;
         getVersionedAttributes(tableName, recordVersion, attrs, positions);
         int recordLength = getDataBufferSize(attrs);
         char recordBuffer[recordLength];
-        RC rc = rbfm.readRecord(fileHandle, attrs, rid, recordBuffer);
-        rbfm.closeFile(fileHandle);
+        rc = rbfm.readRecord(*fileHandle, attrs, rid, recordBuffer);
+        releaseTable(tableName);
         if (rc != 0) return rc;
         convert(tableName, recordVersion, version, recordBuffer, recordLength, data);
         return 0;
@@ -449,11 +670,11 @@ namespace PeterDB {
                                       void *data) {
         if (!checkTableExists(tableName)) return ERR_TABLE_NOT_EXISTS;
 
-        FileHandle fileHandle;
-        rbfm.openFile(getFileName(tableName), fileHandle);
-        int recordVersion = rbfm.getRecordVersion(fileHandle, rid);
-        int curVersion = fileHandle.version;
-        rbfm.closeFile(fileHandle);
+        FileHandle *fileHandle;
+        RC rc = openTable(tableName, fileHandle);
+        if (rc != 0) return rc;
+        int recordVersion = rbfm.getRecordVersion(*fileHandle, rid);
+        int curVersion = fileHandle->version;
 
         std::vector<Attribute> recordAttrs, curAttrs;
         std::vector<int> recordPositions, curPositions;
@@ -466,7 +687,10 @@ namespace PeterDB {
             if (curAttrs[curIndex].name == attributeName) break;
             curIndex = curIndex + 1;
         }
-        if (curIndex >= curAttrs.size()) return ERR_ATTRIBUTE_NOT_EXISTS;
+        if (curIndex >= curAttrs.size()) {
+            releaseTable(tableName);
+            return ERR_ATTRIBUTE_NOT_EXISTS;
+        }
 
         int recordIndex = 0;
         while (recordIndex < recordAttrs.size()) {
@@ -475,14 +699,14 @@ namespace PeterDB {
         }
 
         if (recordIndex >= recordAttrs.size()) {
+            releaseTable(tableName);
             unsigned char c = (unsigned char) 1 << 7;
             std::memcpy(data, &c, 1);
             return 0;
         }
 
-        rbfm.openFile(getFileName(tableName), fileHandle);
-        RC rc = rbfm.readAttribute(fileHandle, recordAttrs, rid, attributeName, data);
-        rbfm.closeFile(fileHandle);
+        rc = rbfm.readAttribute(*fileHandle, recordAttrs, rid, attributeName, data);
+        releaseTable(tableName);
 
         return rc;
     }
@@ -493,15 +717,50 @@ namespace PeterDB {
                              const void *value,
                              const std::vector<std::string> &attributeNames,
                              RM_ScanIterator &rm_ScanIterator) {
-        FileHandle fileHandle;
-        RC rc = rbfm.openFile(getFileName(tableName), fileHandle);
+        std::vector<ScanCondition> conditions;
+        if (!conditionAttribute.empty()) conditions.emplace_back(conditionAttribute, compOp, value);
+        return scan(tableName, conditions, attributeNames, rm_ScanIterator);
+    }
+
+    RC RelationManager::scan(const std::string &tableName,
+                             const std::vector<ScanCondition> &conditions,
+                             const std::vector<std::string> &attributeNames,
+                             RM_ScanIterator &rm_ScanIterator) {
+        std::vector<std::vector<ScanCondition>> disjunction;
+        if (!conditions.empty()) disjunction.push_back(conditions);
+        return scan(tableName, disjunction, attributeNames, rm_ScanIterator);
+    }
+
+    RC RelationManager::scan(const std::string &tableName,
+                             const std::vector<std::vector<ScanCondition>> &disjunction,
+                             const std::vector<std::string> &attributeNames,
+                             RM_ScanIterator &rm_ScanIterator) {
+        rm_ScanIterator.close();
+        RC rc = syncTable(tableName);
+        if (rc != 0) return rc;
+        FileHandle &fileHandle = rm_ScanIterator.rbfm_ScanIterator.fileHandle;
+        rc = rbfm.openFile(getFileName(tableName), fileHandle, true);
         if (rc != 0) return rc;
         std::vector<Attribute> attrs;
         getAttributes(tableName, attrs);
-        rc = rbfm.scan(fileHandle, attrs, conditionAttribute, compOp, value, attributeNames, rm_ScanIterator.rbfm_ScanIterator);
+        rc = rbfm.scan(fileHandle, attrs, disjunction, attributeNames, rm_ScanIterator.rbfm_ScanIterator);
         return rc;
     }
 
+    RC RelationManager::parallelScan(const std::string &tableName,
+                                     const std::vector<std::vector<ScanCondition>> &disjunction,
+                                     const std::vector<std::string> &attributeNames,
+                                     unsigned numberOfWorkers,
+                                     RM_ParallelScanIterator &rm_ParallelScanIterator) {
+        if (!checkTableExists(tableName)) return ERR_TABLE_NOT_EXISTS;
+        std::vector<Attribute> attrs;
+        RC rc = getAttributes(tableName, attrs);
+        if (rc != 0) return rc;
+        rc = syncTable(tableName);
+        if (rc != 0) return rc;
+        return rbfm.parallelScan(getFileName(tableName), attrs, disjunction, attributeNames, numberOfWorkers, rm_ParallelScanIterator.rbfm_ParallelScanIterator);
+    }
+
     RM_ScanIterator::RM_ScanIterator() = default;
 
     RM_ScanIterator::~RM_ScanIterator() = default;
@@ -514,12 +773,24 @@ namespace PeterDB {
         return rbfm_ScanIterator.close();
     }
 
+    RM_ParallelScanIterator::RM_ParallelScanIterator() = default;
+
+    RM_ParallelScanIterator::~RM_ParallelScanIterator() = default;
+
+    RC RM_ParallelScanIterator::getNextTuple(RID &rid, void *data) {
+        return rbfm_ParallelScanIterator.getNextRecord(rid, data);
+    }
+
+    RC RM_ParallelScanIterator::close() {
+        return rbfm_ParallelScanIterator.close();
+    }
+
     int RelationManager::increaseTableVersion(const std::string &tableName) {
-        FileHandle fileHandle;
-        rbfm.openFile(getFileName(tableName), fileHandle);
-        rbfm.increaseVersion(fileHandle);
-        int version = fileHandle.version;
-        rbfm.closeFile(fileHandle);
+        FileHandle *fileHandle;
+        if (openTable(tableName, fileHandle) != 0) return -1;
+        rbfm.increaseVersion(*fileHandle);
+        int version = fileHandle->version;
+        releaseTable(tableName);
         return version;
     }
 
@@ -556,6 +827,7 @@ namespace PeterDB {
         rm_ScanIterator.close();
         rbfm.closeFile(columnsHandle);
 
+        invalidateCatalog(tableName);
         return rc;
     }
 
@@ -586,6 +858,7 @@ namespace PeterDB {
         }
 
         rm_ScanIterator.close();
+        invalidateCatalog(tableName);
         if (rc != 0) return rc;
 
         rc = insertColumn(columnsHandle, tableId, attr, position, newVersion);
@@ -597,10 +870,12 @@ namespace PeterDB {
     // QE IX related
     RC RelationManager::modifyIndex(const std::string &tableName, const void *data, const RID &rid, const std::vector<Attribute> &attrs,
                                     const std::vector<int> &positions, bool insertion) {
-        RC rc;
+        FileHandle *fileHandle;
+        RC rc = openTable(tableName, fileHandle);
+        if (rc != 0) return rc;
         int size = attrs.size();
         RID ridBuffer;
-        IXFileHandle ixFileHandle;
+        IXFileHandle *ixFileHandle;
         int numberOfNullBytes = size % 8 == 0 ? size / 8 : size / 8 + 1;
         char bitmaps[numberOfNullBytes];
         std::memcpy(bitmaps, data, numberOfNullBytes);
@@ -618,34 +893,36 @@ namespace PeterDB {
             if (hasIndexOn(tableName, positions[i], ridBuffer)) {
                 char key[keyLength];
                 std::memcpy(&key, (char *) data + offset, keyLength);
-                ix.openFile(getIndexFileName(tableName, positions[i]), ixFileHandle);
-                if (insertion) rc = ix.insertEntry(ixFileHandle, attrs[i], key, rid);
-                else rc = ix.deleteEntry(ixFileHandle, attrs[i], key, rid);
-                ix.closeFile(ixFileHandle);
-                if (rc != 0) return rc;
+                rc = openIndex(tableName, positions[i], ixFileHandle);
+                if (rc == 0 && insertion) rc = ix.insertEntry(*ixFileHandle, attrs[i], key, rid);
+                else if (rc == 0) rc = ix.deleteEntry(*ixFileHandle, attrs[i], key, rid);
+                if (rc != 0) {
+                    releaseTable(tableName);
+                    return rc;
+                }
             }
             offset = offset + keyLength;
         }
+        releaseTable(tableName);
         return 0;
     }
 
     int RelationManager::getColumnPosition(const std::string &tableName, const std::string &attributeName, Attribute &attrBuffer) {
-        FileHandle fileHandle;
-        rbfm.openFile(getFileName(tableName), fileHandle);
+        FileHandle *fileHandle;
+        if (openTable(tableName, fileHandle) != 0) return -1;
         std::vector<Attribute> attrs;
         std::vector<int> positions;
-        getVersionedAttributes(tableName, fileHandle.version, attrs, positions);
+        getVersionedAttributes(tableName, fileHandle->version, attrs, positions);
+        releaseTable(tableName);
 
         int size = attrs.size();
         for (int i = 0; i < size; i++) {
             if (attrs[i].name == attributeName) {
-                rbfm.closeFile(fileHandle);
                 attrBuffer = attrs[i];
                 return positions[i];
             }
         }
 
-        rbfm.closeFile(fileHandle);
         return -1;
     }
 
@@ -655,19 +932,28 @@ namespace PeterDB {
 
     bool RelationManager::hasIndexOn(const std::string &tableName, int columnPosition, RID &rid) {
         int tableId = getTableId(tableName);
-        RM_ScanIterator rm_ScanIterator;
-        scan(indexesName, "table-id", EQ_OP, &tableId, {"column-position"}, rm_ScanIterator);
-
-        int columnPositionBuffer;
-        while (rm_ScanIterator.getNextTuple(rid, tableIdBuffer) != RM_EOF) {
-            std::memcpy(&columnPositionBuffer, (char *) tableIdBuffer + 1, sizeof(int));
-            if (columnPositionBuffer == columnPosition) {
-                rm_ScanIterator.close();
-                return true;
+        auto it = catalogCache.find(tableName);
+        if (it == catalogCache.end()) return false;
+        TableCatalog &catalog = it->second;
+
+        if (!catalog.indexesLoaded) {
+            RM_ScanIterator rm_ScanIterator;
+            scan(indexesName, "table-id", EQ_OP, &tableId, {"column-position"}, rm_ScanIterator);
+            RID ridBuffer;
+            int columnPositionBuffer;
+            while (rm_ScanIterator.getNextTuple(ridBuffer, tableIdBuffer) != RM_EOF) {
+                std::memcpy(&columnPositionBuffer, (char *) tableIdBuffer + 1, sizeof(int));
+                catalog.indexes.emplace_back(columnPositionBuffer, ridBuffer);
             }
+            rm_ScanIterator.close();
+            catalog.indexesLoaded = true;
         }
 
-        rm_ScanIterator.close();
+        for (const std::pair<int, RID> &index : catalog.indexes) {
+            if (index.first != columnPosition) continue;
+            rid = index.second;
+            return true;
+        }
         return false;
     }
 
@@ -690,6 +976,7 @@ namespace PeterDB {
 
         int tableId = getTableId(tableName);
         rc = insertIndexes(indexesHandle, tableId, columnPosition);
+        invalidateCatalog(tableName);
         if (rc != 0) return rc;
 
         rc = rbfm.closeFile(indexesHandle);
@@ -699,20 +986,16 @@ namespace PeterDB {
         scan(tableName, "", NO_OP, nullptr, {attributeName}, rm_ScanIterator);
         IXFileHandle ixFileHandle;
         ix.openFile(indexFileName, ixFileHandle);
-        while (rm_ScanIterator.getNextTuple(rid, tupleBuffer) != RM_EOF) {
+        IX_BulkLoader ix_BulkLoader(ixFileHandle, attrBuffer);
+        while (rc == 0 && rm_ScanIterator.getNextTuple(rid, tupleBuffer) != RM_EOF) {
             if (((char *) tupleBuffer)[0] >> 7u & 1u) continue;
-            int keyLength = 0;
-            if (attrBuffer.type == 2) std::memcpy(&keyLength, (char *) tupleBuffer + 1, sizeof(int));
-            keyLength = keyLength + sizeof(int);
-            char key[keyLength];
-            std::memcpy(key, (char *) tupleBuffer + 1, keyLength);
-            rc = ix.insertEntry(ixFileHandle, attrBuffer, key, rid);
-            if (rc != 0) return rc;
+            rc = ix_BulkLoader.addEntry((char *) tupleBuffer + 1, rid);
         }
-        ix.closeFile(ixFileHandle);
         rm_ScanIterator.close();
+        if (rc == 0) rc = ix_BulkLoader.finish();
+        ix.closeFile(ixFileHandle);
 
-        return 0;
+        return rc;
     }
 
     RC RelationManager::destroyIndex(const std::string &tableName, const std::string &attributeName){
@@ -725,11 +1008,34 @@ namespace PeterDB {
         RID rid;
         if (!hasIndexOn(tableName, columnPosition, rid)) return ERR_INDEX_DELETE_ON_NON_EXISTS_INDEX;
 
+        closeIndex(tableName, columnPosition);
         std::string indexFileName = getIndexFileName(tableName, columnPosition);
         RC rc = ix.destroyFile(indexFileName);
         if (rc != 0) return rc;
 
-        return deleteFromSystemFiles(indexesName, rid);
+        rc = deleteFromSystemFiles(indexesName, rid);
+        invalidateCatalog(tableName);
+        return rc;
+    }
+
+    RC RelationManager::compactIndex(const std::string &tableName, const std::string &attributeName, float fillFactor) {
+        if (!checkTableExists(tableName)) return ERR_TABLE_NOT_EXISTS;
+
+        Attribute attrBuffer;
+        int columnPosition = getColumnPosition(tableName, attributeName, attrBuffer);
+        if (columnPosition < 0) return ERR_INDEX_COMPACT_ON_NON_EXISTS_COL;
+
+        RID rid;
+        if (!hasIndexOn(tableName, columnPosition, rid)) return ERR_INDEX_COMPACT_ON_NON_EXISTS_INDEX;
+
+        FileHandle *fileHandle;
+        RC rc = openTable(tableName, fileHandle);
+        if (rc != 0) return rc;
+        IXFileHandle *ixFileHandle;
+        rc = openIndex(tableName, columnPosition, ixFileHandle);
+        if (rc == 0) rc = ix.compactIndex(*ixFileHandle, attrBuffer, fillFactor);
+        releaseTable(tableName);
+        return rc;
     }
 
     // indexScan returns an iterator to allow the caller to go through qualified entries in index
@@ -749,7 +1055,9 @@ namespace PeterDB {
         RID rid;
         if (!hasIndexOn(tableName, columnPosition, rid)) return ERR_INDEX_SCAN_ON_NON_EXISTS_INDEX;
 
-        ix.openFile(getIndexFileName(tableName, columnPosition), rm_IndexScanIterator.ixFileHandle);
+        RC rc = syncTable(tableName);
+        if (rc != 0) return rc;
+        ix.openFile(getIndexFileName(tableName, columnPosition), rm_IndexScanIterator.ixFileHandle, true);
         return ix.scan(rm_IndexScanIterator.ixFileHandle, attrBuffer, lowKey, highKey, lowKeyInclusive, highKeyInclusive, rm_IndexScanIterator.ix_ScanIterator);
     }
 
@@ -762,6 +1070,15 @@ namespace PeterDB {
         return ix_ScanIterator.getNextEntry(rid, key);
     }
 
+    RC RM_IndexScanIterator::getNextEntries(std::vector<RID> &rids, void *keys, unsigned maxCount){
+        return ix_ScanIterator.getNextEntries(rids, keys, maxCount);
+    }
+
+    RC RM_IndexScanIterator::seek(const void *lowKey, const void *highKey, bool lowKeyInclusive, bool highKeyInclusive){
+        if (ixFileHandle.fileHandle.pFile == nullptr) return ERR_INDEX_FILE_NOT_EXISTS;
+        return ix_ScanIterator.seek(lowKey, highKey, lowKeyInclusive, highKeyInclusive);
+    }
+
     RC RM_IndexScanIterator::close(){
         RC rc = ix.closeFile(ixFileHandle);
         if (rc != 0) return 0;
@@ -1392,4 +1392,112 @@ namespace PeterDBTesting {
 
     }
 
+    TEST_F(IX_Test, bulk_load_entries) {
+        // Functions tested
+        // 1. Bulk load entries given out of order into an empty index, spilling sorted runs
+        // 2. Bulk load more entries into the index that now has entries
+        // 3. Scan
+
+        unsigned numOfEntries = 200000;     // more entries than fit in one sorted run
+        {
+            PeterDB::IX_BulkLoader loader(ixFileHandle, ageAttr);
+            for (unsigned i = 0; i < numOfEntries; i++) {
+                int key = (int) (i * 7919 % numOfEntries);
+                rid.pageNum = key;
+                rid.slotNum = key % SHRT_MAX;
+                ASSERT_EQ(loader.addEntry(&key, rid), success) << "IX_BulkLoader::addEntry() should succeed.";
+            }
+            EXPECT_GT(glob(TEMP_FILE_PREFIX "bulkload_").size(), 0) << "Sorted runs should have been spilled.";
+            ASSERT_EQ(loader.finish(), success) << "IX_BulkLoader::finish() should succeed.";
+        }
+        EXPECT_EQ(glob(TEMP_FILE_PREFIX "bulkload_").size(), 0) << "There should be no run file left.";
+
+        // Leaves are packed full, an index built by insertion leaves them about half full
+        EXPECT_LT(getFileSize(indexFileName) / PAGE_SIZE, 2 * numOfEntries * 12 / PAGE_SIZE)
+                            << "Bulk loaded leaves should be packed.";
+
+        {
+            PeterDB::IX_BulkLoader loader(ixFileHandle, ageAttr);
+            for (unsigned i = 0; i < 1000; i++) {
+                int key = (int) (numOfEntries + 999 - i);
+                rid.pageNum = key;
+                rid.slotNum = key % SHRT_MAX;
+                ASSERT_EQ(loader.addEntry(&key, rid), success) << "IX_BulkLoader::addEntry() should succeed.";
+            }
+            ASSERT_EQ(loader.finish(), success) << "IX_BulkLoader::finish() should succeed.";
+        }
+
+        reopenIndexFile();
+        ASSERT_EQ(ix.scan(ixFileHandle, ageAttr, nullptr, nullptr, true, true, ix_ScanIterator), success)
+                                    << "indexManager::scan() should succeed.";
+        int key, count = 0;
+        while (ix_ScanIterator.getNextEntry(rid, &key) == success) {
+            ASSERT_EQ(key, count) << "Keys should be returned in order.";
+            ASSERT_EQ(rid.pageNum, (unsigned) key) << "rid.pageNum is not correct.";
+            ASSERT_EQ(rid.slotNum, (unsigned) key % SHRT_MAX) << "rid.slotNum is not correct.";
+            count++;
+        }
+        ASSERT_EQ(count, numOfEntries + 1000) << "scan count is not correct.";
+        ASSERT_EQ(ix_ScanIterator.close(), success) << "IX_ScanIterator::close() should succeed.";
+    }
+
+    TEST_F(IX_Test, get_next_entries_and_seek) {
+        // Functions tested
+        // 1. Get entries in batches
+        // 2. Restart an open scan at new key ranges
+
+        unsigned numOfEntries = 1000;
+        for (unsigned i = 0; i < numOfEntries; i++) {
+            int key = (int) ((i * 37) % numOfEntries);
+            rid.pageNum = key;
+            rid.slotNum = key + 1;
+            ASSERT_EQ(ix.insertEntry(ixFileHandle, ageAttr, &key, rid), success)
+                                        << "indexManager::insertEntry() should succeed.";
+        }
+
+        // 100 <= key < 600 in batches of at most 64
+        int lowKey = 100, highKey = 600;
+        ASSERT_EQ(ix.scan(ixFileHandle, ageAttr, &lowKey, &highKey, true, false, ix_ScanIterator), success)
+                                    << "indexManager::scan() should succeed.";
+        std::vector<PeterDB::RID> batch;
+        int keys[64];
+        int expected = lowKey;
+        while (ix_ScanIterator.getNextEntries(batch, keys, 64) == success) {
+            ASSERT_TRUE(!batch.empty() && batch.size() <= 64) << "A batch should hold 1 to 64 entries.";
+            for (unsigned j = 0; j < batch.size(); j++) {
+                ASSERT_EQ(keys[j], expected) << "Keys should be returned in order.";
+                ASSERT_EQ(batch[j].pageNum, (unsigned) expected) << "rid.pageNum is not correct.";
+                ASSERT_EQ(batch[j].slotNum, (unsigned) expected + 1) << "rid.slotNum is not correct.";
+                expected++;
+            }
+        }
+        ASSERT_EQ(expected, highKey) << "The batches should cover the key range.";
+
+        // 900 < key, one entry at a time
+        lowKey = 900;
+        ASSERT_EQ(ix_ScanIterator.seek(&lowKey, nullptr, false, true), success) << "IX_ScanIterator::seek() should succeed.";
+        int key;
+        expected = lowKey + 1;
+        while (ix_ScanIterator.getNextEntry(rid, &key) == success) {
+            ASSERT_EQ(key, expected) << "Keys should be returned in order.";
+            expected++;
+        }
+        ASSERT_EQ(expected, numOfEntries) << "The scan should reach the last key.";
+
+        // Back to 10 <= key <= 20, rids only
+        lowKey = 10;
+        highKey = 20;
+        ASSERT_EQ(ix_ScanIterator.seek(&lowKey, &highKey, true, true), success) << "IX_ScanIterator::seek() should succeed.";
+        unsigned count = 0;
+        while (ix_ScanIterator.getNextEntries(batch, nullptr, 4) == success) {
+            for (const auto &batchRid : batch) {
+                ASSERT_EQ(batchRid.pageNum, lowKey + count) << "rid.pageNum is not correct.";
+                count++;
+            }
+        }
+        ASSERT_EQ(count, 11) << "scan count is not correct.";
+
+        ASSERT_EQ(ix_ScanIterator.close(), success) << "IX_ScanIterator::close() should succeed.";
+    }
+
 } // namespace PeterDBTesting
\ No newline at end of file
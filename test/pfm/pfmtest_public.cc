@@ -360,4 +360,123 @@ namespace PeterDBTesting {
         }
     }
 
+    TEST_F (PFM_Page_Test, buffer_pool_hit_evict_and_write_back) {
+        // Functions Tested:
+        // 1. Append Page
+        // 2. Read Page through the buffer pool
+        // 3. Write Page in write-back mode
+        // 4. Flush
+
+        PeterDB::BufferPool &bufferPool = pfm.getBufferPool();
+        unsigned numberOfFrames = bufferPool.getNumberOfFrames();
+        ASSERT_EQ(bufferPool.setNumberOfFrames(4), success) << "Resizing the buffer pool should succeed.";
+
+        inBuffer = malloc(PAGE_SIZE);
+        outBuffer = malloc(PAGE_SIZE);
+        for (unsigned i = 0; i < 8; i++) {
+            generateData(inBuffer, PAGE_SIZE, i + 1, i);
+            ASSERT_EQ(fileHandle.appendPage(inBuffer), success) << "Appending a page should succeed.";
+        }
+
+        unsigned hitCount, missCount, readPageCount, writePageCount, appendPageCount;
+        unsigned updatedHitCount, updatedMissCount, updatedReadPageCount;
+        ASSERT_EQ(bufferPool.collectCounterValues(hitCount, missCount), success)
+                                    << "Collecting buffer pool counters should succeed.";
+        ASSERT_EQ(fileHandle.collectCounterValues(readPageCount, writePageCount, appendPageCount), success)
+                                    << "Collecting counters should succeed.";
+
+        // The first read of a page misses, the second one hits
+        ASSERT_EQ(fileHandle.readPage(0, outBuffer), success) << "Reading a page should succeed.";
+        ASSERT_EQ(fileHandle.readPage(0, outBuffer), success) << "Reading a page should succeed.";
+        ASSERT_EQ(bufferPool.collectCounterValues(updatedHitCount, updatedMissCount), success)
+                                    << "Collecting buffer pool counters should succeed.";
+        ASSERT_EQ(updatedHitCount - hitCount, 1) << "Reading a cached page should hit.";
+        ASSERT_EQ(updatedMissCount - missCount, 1) << "Reading an uncached page should miss.";
+
+        // Four more pages fill the pool and evict the least recently used page 0
+        for (unsigned i = 1; i <= 4; i++) {
+            ASSERT_EQ(fileHandle.readPage(i, outBuffer), success) << "Reading a page should succeed.";
+        }
+        ASSERT_EQ(fileHandle.readPage(0, outBuffer), success) << "Reading a page should succeed.";
+        generateData(inBuffer, PAGE_SIZE, 1, 0);
+        ASSERT_EQ(memcmp(inBuffer, outBuffer, PAGE_SIZE), 0) << "Checking the integrity of the page should succeed.";
+        ASSERT_EQ(bufferPool.collectCounterValues(updatedHitCount, updatedMissCount), success)
+                                    << "Collecting buffer pool counters should succeed.";
+        ASSERT_EQ(updatedHitCount - hitCount, 1) << "No read after the first hit should hit.";
+        ASSERT_EQ(updatedMissCount - missCount, 6) << "Page 0 should have been evicted and read again.";
+        ASSERT_EQ(fileHandle.collectCounterValues(updatedReadPageCount, writePageCount, appendPageCount), success)
+                                    << "Collecting counters should succeed.";
+        ASSERT_EQ(updatedReadPageCount - readPageCount, 6) << "Only misses should read from disk.";
+
+        // A write-back page stays in the pool until it is evicted
+        fileHandle.writeBack = true;
+        generateData(inBuffer, PAGE_SIZE, 50, 7);
+        ASSERT_EQ(fileHandle.writePage(5, inBuffer), success) << "Writing a page should succeed.";
+        ASSERT_EQ(fileHandle.readPageFromDisk(5, outBuffer), success) << "Reading a page from disk should succeed.";
+        ASSERT_NE(memcmp(inBuffer, outBuffer, PAGE_SIZE), 0) << "The page should not be on disk yet.";
+        ASSERT_EQ(fileHandle.readPage(5, outBuffer), success) << "Reading a page should succeed.";
+        ASSERT_EQ(memcmp(inBuffer, outBuffer, PAGE_SIZE), 0) << "The page should be read from the pool.";
+        for (unsigned i = 0; i < 4; i++) {
+            ASSERT_EQ(fileHandle.readPage(i, outBuffer), success) << "Reading a page should succeed.";
+        }
+        ASSERT_EQ(fileHandle.readPageFromDisk(5, outBuffer), success) << "Reading a page from disk should succeed.";
+        ASSERT_EQ(memcmp(inBuffer, outBuffer, PAGE_SIZE), 0) << "The evicted page should have been written back.";
+
+        // ... or the file is flushed
+        generateData(inBuffer, PAGE_SIZE, 60, 9);
+        ASSERT_EQ(fileHandle.writePage(6, inBuffer), success) << "Writing a page should succeed.";
+        ASSERT_EQ(fileHandle.flush(), success) << "Flushing the file should succeed.";
+        ASSERT_EQ(fileHandle.readPageFromDisk(6, outBuffer), success) << "Reading a page from disk should succeed.";
+        ASSERT_EQ(memcmp(inBuffer, outBuffer, PAGE_SIZE), 0) << "The flushed page should be on disk.";
+
+        ASSERT_EQ(bufferPool.setNumberOfFrames(numberOfFrames), success) << "Resizing the buffer pool should succeed.";
+    }
+
+    TEST_F (PFM_Page_Test, write_back_counts_physical_writes) {
+        // Functions Tested:
+        // 1. Append Page
+        // 2. Write Page in write-back mode
+        // 3. Flush
+        // 4. Destroy File while open
+
+        PeterDB::BufferPool &bufferPool = pfm.getBufferPool();
+        unsigned numberOfFrames = bufferPool.getNumberOfFrames();
+        ASSERT_EQ(bufferPool.setNumberOfFrames(4), success) << "Resizing the buffer pool should succeed.";
+
+        inBuffer = malloc(PAGE_SIZE);
+        outBuffer = malloc(PAGE_SIZE);
+        for (unsigned i = 0; i < 16; i++) {
+            generateData(inBuffer, PAGE_SIZE, i + 1, i);
+            ASSERT_EQ(fileHandle.appendPage(inBuffer), success) << "Appending a page should succeed.";
+        }
+
+        unsigned readPageCount, writePageCount, appendPageCount, updatedWritePageCount;
+        ASSERT_EQ(fileHandle.collectCounterValues(readPageCount, writePageCount, appendPageCount), success)
+                                    << "Collecting counters should succeed.";
+
+        // Each page is written ten times in a row, but reaches disk once on eviction or flush
+        fileHandle.writeBack = true;
+        for (unsigned i = 0; i < 16; i++) {
+            for (unsigned j = 0; j < 10; j++) {
+                generateData(inBuffer, PAGE_SIZE, i + j + 1, i);
+                ASSERT_EQ(fileHandle.writePage(i, inBuffer), success) << "Writing a page should succeed.";
+            }
+        }
+        ASSERT_EQ(fileHandle.flush(), success) << "Flushing the file should succeed.";
+        ASSERT_EQ(fileHandle.collectCounterValues(readPageCount, updatedWritePageCount, appendPageCount), success)
+                                    << "Collecting counters should succeed.";
+        ASSERT_EQ(updatedWritePageCount - writePageCount, 16) << "Only pages written back should be counted.";
+
+        for (unsigned i = 0; i < 16; i++) {
+            generateData(inBuffer, PAGE_SIZE, i + 10, i);
+            ASSERT_EQ(fileHandle.readPageFromDisk(i, outBuffer), success) << "Reading a page from disk should succeed.";
+            ASSERT_EQ(memcmp(inBuffer, outBuffer, PAGE_SIZE), 0) << "The last write of a page should be on disk.";
+        }
+
+        ASSERT_NE(pfm.destroyFile(fileName), success) << "Destroying an open file should fail.";
+        ASSERT_TRUE(fileExists(fileName)) << "The open file should not be removed.";
+
+        ASSERT_EQ(bufferPool.setNumberOfFrames(numberOfFrames), success) << "Resizing the buffer pool should succeed.";
+    }
+
 } // namespace PeterDBTesting
\ No newline at end of file
@@ -1520,4 +1520,447 @@ namespace PeterDBTesting {
 
     }
 
+    TEST_F(QE_Test, bnljoin_with_page_sized_outer_tuples) {
+        // 1. BNLJoin -- one outer tuple and its hash table do not fit in one page together
+        // SELECT * FROM wide, right where wide.A = right.B
+
+        inBuffer = malloc(PAGE_SIZE);
+        outBuffer = malloc(2 * PAGE_SIZE);
+
+        std::string wideTableName = "wide";
+        unsigned length = 4072;     // the tuple takes 4081 bytes, leaving less than a two-slot table in the page
+        ASSERT_EQ(rm.createTable(wideTableName, {{"A", PeterDB::TypeInt, 4}, {"B", PeterDB::TypeVarChar, length}}),
+                  success) << "Create table " << wideTableName << " should succeed.";
+        tableNames.emplace_back(wideTableName);
+
+        std::string rightTableName = "right";
+        createAndPopulateTable(rightTableName, {}, 100);
+
+        std::string b(length, 'x');
+        for (unsigned i = 0; i < 10; i++) {
+            unsigned a = i * 10 + 20;
+            memset(inBuffer, 0, 1);
+            memcpy((char *) inBuffer + 1, &a, sizeof(unsigned));
+            memcpy((char *) inBuffer + 5, &length, sizeof(unsigned));
+            memcpy((char *) inBuffer + 9, b.c_str(), length);
+            ASSERT_EQ(rm.insertTuple(wideTableName, inBuffer, rid), success)
+                                        << "relationManager.insertTuple() should succeed.";
+        }
+
+        PeterDB::TableScan leftIn(rm, wideTableName);
+        PeterDB::TableScan rightIn(rm, rightTableName);
+
+        // Create BNLJoin with a single page for the outer tuples and their hash table
+        PeterDB::BNLJoin bnlJoin(&leftIn, &rightIn, {"wide.A", PeterDB::EQ_OP, true, "right.B"}, 1);
+
+        // Every outer tuple matches the one right tuple with its key
+        unsigned count = 0, a, rightB;
+        while (bnlJoin.getNextTuple(outBuffer) != QE_EOF) {
+            memcpy(&a, (char *) outBuffer + 1, sizeof(unsigned));
+            memcpy(&rightB, (char *) outBuffer + 9 + length, sizeof(unsigned));
+            ASSERT_EQ(a, rightB) << "The joined tuples should have the same key.";
+            ASSERT_EQ(memcmp((char *) outBuffer + 9, b.c_str(), length), 0) << "The outer tuple should be intact.";
+            count++;
+        }
+        ASSERT_EQ(count, 10) << "The number of returned tuple is not correct.";
+
+    }
+
+    TEST_F(QE_Test, bnljoin_with_null_inner_keys_after_a_full_chunk) {
+        // 1. BNLJoin -- the inner tuples left after a full chunk all have null keys, the outer input takes several blocks
+        // SELECT * FROM outer, inner where outer.B = inner.B
+
+        inBuffer = malloc(bufSize);
+        outBuffer = malloc(bufSize);
+
+        std::string outerTableName = "outer";
+        std::string innerTableName = "inner";
+        for (const auto &tableName : {outerTableName, innerTableName}) {
+            ASSERT_EQ(rm.createTable(tableName, {{"A", PeterDB::TypeInt, 4}, {"B", PeterDB::TypeInt, 4}}), success)
+                                        << "Create table " << tableName << " should succeed.";
+            tableNames.emplace_back(tableName);
+        }
+
+        // 455 tuples of 9 bytes fill the one-page inner chunk, the 5-byte tuples with a null B after them do not fit
+        unsigned numKeys = 455;
+        for (unsigned i = 0; i < numKeys + 100; i++) {
+            memset(inBuffer, i < numKeys ? 0 : 0x40, 1);
+            memcpy((char *) inBuffer + 1, &i, sizeof(unsigned));
+            memcpy((char *) inBuffer + 5, &i, sizeof(unsigned));
+            ASSERT_EQ(rm.insertTuple(innerTableName, inBuffer, rid), success)
+                                        << "relationManager.insertTuple() should succeed.";
+        }
+
+        // Far more outer tuples than the three-page outer block holds, each matching one inner tuple
+        unsigned numOuterTuples = 5000;
+        for (unsigned i = 0; i < numOuterTuples; i++) {
+            unsigned b = i % numKeys;
+            memset(inBuffer, 0, 1);
+            memcpy((char *) inBuffer + 1, &i, sizeof(unsigned));
+            memcpy((char *) inBuffer + 5, &b, sizeof(unsigned));
+            ASSERT_EQ(rm.insertTuple(outerTableName, inBuffer, rid), success)
+                                        << "relationManager.insertTuple() should succeed.";
+        }
+
+        PeterDB::TableScan leftIn(rm, outerTableName);
+        PeterDB::TableScan rightIn(rm, innerTableName);
+
+        // Four pages: one for the inner chunk, three for the outer block
+        PeterDB::BNLJoin bnlJoin(&leftIn, &rightIn, {"outer.B", PeterDB::EQ_OP, true, "inner.B"}, 4);
+
+        std::vector<bool> joined(numOuterTuples, false);
+        unsigned count = 0, a, outerB, innerB;
+        while (bnlJoin.getNextTuple(outBuffer) != QE_EOF) {
+            memcpy(&a, (char *) outBuffer + 1, sizeof(unsigned));
+            memcpy(&outerB, (char *) outBuffer + 5, sizeof(unsigned));
+            memcpy(&innerB, (char *) outBuffer + 13, sizeof(unsigned));
+            ASSERT_EQ(outerB, innerB) << "The joined tuples should have the same key.";
+            ASSERT_LT(a, numOuterTuples) << "The outer tuple is not correct.";
+            ASSERT_FALSE(joined[a]) << "An outer tuple should be joined once.";
+            joined[a] = true;
+            count++;
+        }
+        ASSERT_EQ(count, numOuterTuples) << "Every outer block should have been joined.";
+
+    }
+
+    TEST_F(QE_Test, inljoin_with_duplicate_keys_across_batches) {
+        // 1. INLJoin -- outer keys repeated within and across batches, one inner key with more tuples than are kept
+        // SELECT * FROM outer, inner where outer.B = inner.B
+
+        inBuffer = malloc(bufSize);
+        outBuffer = malloc(bufSize);
+
+        std::string outerTableName = "outer";
+        std::string innerTableName = "inner";
+        for (const auto &tableName : {outerTableName, innerTableName}) {
+            ASSERT_EQ(rm.createTable(tableName, {{"A", PeterDB::TypeInt, 4}, {"B", PeterDB::TypeInt, 4}}), success)
+                                        << "Create table " << tableName << " should succeed.";
+            tableNames.emplace_back(tableName);
+        }
+        ASSERT_EQ(rm.createIndex(innerTableName, "B"), success) << "RelationManager.createIndex() should succeed.";
+
+        // Key 0 has 8000 inner tuples, more than INLJOIN_BATCH_PAGES pages; keys 1 to 99 have one each
+        unsigned numZeros = 8000;
+        for (unsigned i = 0; i < numZeros + 99; i++) {
+            unsigned b = i < numZeros ? 0 : i - numZeros + 1;
+            memset(inBuffer, 0, 1);
+            memcpy((char *) inBuffer + 1, &i, sizeof(unsigned));
+            memcpy((char *) inBuffer + 5, &b, sizeof(unsigned));
+            ASSERT_EQ(rm.insertTuple(innerTableName, inBuffer, rid), success)
+                                        << "relationManager.insertTuple() should succeed.";
+        }
+
+        // The outer tuples take two batches; key 0 comes twice in the first and once in the second
+        unsigned numOuterTuples = 8000;
+        for (unsigned i = 0; i < numOuterTuples; i++) {
+            unsigned b = i == 10 || i == 20 || i == 7990 ? 0 : 1 + i % 99;
+            memset(inBuffer, 0, 1);
+            memcpy((char *) inBuffer + 1, &i, sizeof(unsigned));
+            memcpy((char *) inBuffer + 5, &b, sizeof(unsigned));
+            ASSERT_EQ(rm.insertTuple(outerTableName, inBuffer, rid), success)
+                                        << "relationManager.insertTuple() should succeed.";
+        }
+
+        PeterDB::TableScan leftIn(rm, outerTableName);
+        PeterDB::IndexScan rightIn(rm, innerTableName, "B");
+
+        // Every lookup has to go through the index scan opened above, a new one would not find the moved file
+        std::vector<std::string> indexFileNames = glob(".idx");
+        ASSERT_EQ(indexFileNames.size(), 1) << "There should be one index file.";
+        std::string movedFileName = indexFileNames[0] + ".moved";
+        ASSERT_EQ(rename(indexFileNames[0].c_str(), movedFileName.c_str()), 0) << "Moving the index file should succeed.";
+
+        std::vector<unsigned> matchCounts(numOuterTuples, 0), innerASums(numOuterTuples, 0);
+        unsigned count = 0, outerA, outerB, innerA, innerB;
+        bool keysMatch = true, outerInRange = true;
+        {
+            PeterDB::INLJoin inlJoin(&leftIn, &rightIn, {"outer.B", PeterDB::EQ_OP, true, "inner.B"});
+            while (inlJoin.getNextTuple(outBuffer) != QE_EOF) {
+                memcpy(&outerA, (char *) outBuffer + 1, sizeof(unsigned));
+                memcpy(&outerB, (char *) outBuffer + 5, sizeof(unsigned));
+                memcpy(&innerA, (char *) outBuffer + 9, sizeof(unsigned));
+                memcpy(&innerB, (char *) outBuffer + 13, sizeof(unsigned));
+                keysMatch = keysMatch && outerB == innerB;
+                outerInRange = outerInRange && outerA < numOuterTuples;
+                if (outerA < numOuterTuples) {
+                    matchCounts[outerA]++;
+                    innerASums[outerA] += innerA;
+                }
+                count++;
+            }
+        }
+        ASSERT_EQ(rename(movedFileName.c_str(), indexFileNames[0].c_str()), 0) << "Moving the index file back should succeed.";
+
+        ASSERT_TRUE(keysMatch) << "The joined tuples should have the same key.";
+        ASSERT_TRUE(outerInRange) << "The outer tuples are not correct.";
+        ASSERT_EQ(count, 3 * numZeros + numOuterTuples - 3) << "The number of returned tuple is not correct.";
+        for (unsigned i = 0; i < numOuterTuples; i++) {
+            if (i == 10 || i == 20 || i == 7990) {
+                ASSERT_EQ(matchCounts[i], numZeros) << "Outer tuple " << i << " should meet every inner tuple of key 0.";
+                ASSERT_EQ(innerASums[i], numZeros * (numZeros - 1) / 2) << "Outer tuple " << i << " should meet each once.";
+            } else {
+                ASSERT_EQ(matchCounts[i], 1) << "Outer tuple " << i << " should meet one inner tuple.";
+                ASSERT_EQ(innerASums[i], numZeros + i % 99) << "Outer tuple " << i << " should meet the tuple of its key.";
+            }
+        }
+
+    }
+
+    TEST_F(QE_Test, index_scan_in_heap_order) {
+        // 1. IndexScan -- tuples of a key range in heap order rather than key order
+        // SELECT * FROM left WHERE B <= 30
+
+        inBuffer = malloc(bufSize);
+        outBuffer = malloc(bufSize);
+
+        std::string tableName = "left";
+        createAndPopulateTable(tableName, {"B"}, 200);
+
+        // B wraps around at 197, so key order and heap order differ
+        unsigned highKey = 30;
+        std::vector<unsigned> expected;
+        for (unsigned i = 0; i < 200; i++) {
+            if ((i + 10) % 197 <= highKey) expected.push_back(i);
+        }
+
+        PeterDB::IndexScan heapScan(rm, tableName, "B", nullptr, true);
+        heapScan.setIterator(nullptr, &highKey, true, true);
+        ASSERT_FALSE(heapScan.isOrderedOn("left.B")) << "A heap-order scan is not ordered on its key.";
+        std::vector<unsigned> heapOrder;
+        while (heapScan.getNextTuple(outBuffer) != QE_EOF) {
+            heapOrder.push_back(*(unsigned *) ((char *) outBuffer + 1));
+        }
+        ASSERT_EQ(heapOrder, expected) << "Tuples should come in the order they are stored.";
+
+        PeterDB::IndexScan keyScan(rm, tableName, "B");
+        keyScan.setIterator(nullptr, &highKey, true, true);
+        ASSERT_TRUE(keyScan.isOrderedOn("left.B")) << "An index scan is ordered on its key.";
+        std::vector<unsigned> keyOrder;
+        unsigned lastB = 0;
+        while (keyScan.getNextTuple(outBuffer) != QE_EOF) {
+            unsigned b = *(unsigned *) ((char *) outBuffer + 5);
+            ASSERT_GE(b, lastB) << "Tuples should come in key order.";
+            lastB = b;
+            keyOrder.push_back(*(unsigned *) ((char *) outBuffer + 1));
+        }
+        std::sort(keyOrder.begin(), keyOrder.end());
+        ASSERT_EQ(keyOrder, expected) << "Both orders should return the same tuples.";
+
+        // A new key range collects its rids again
+        unsigned lowKey = 100;
+        highKey = 110;
+        heapScan.setIterator(&lowKey, &highKey, true, true);
+        heapOrder.clear();
+        while (heapScan.getNextTuple(outBuffer) != QE_EOF) {
+            heapOrder.push_back(*(unsigned *) ((char *) outBuffer + 1));
+        }
+        expected.clear();
+        for (unsigned i = 90; i <= 100; i++) expected.push_back(i);
+        ASSERT_EQ(heapOrder, expected) << "Tuples should come in the order they are stored.";
+
+    }
+
+    TEST_F(QE_Test, ghjoin_with_repartition_and_skew) {
+        // 1. GHJoin -- partitions too large to build in memory, one of them a single key
+        // SELECT * FROM skew, right WHERE skew.B = right.B
+
+        inBuffer = malloc(bufSize);
+        outBuffer = malloc(bufSize);
+
+        std::string skewTableName = "skew";
+        ASSERT_EQ(rm.createTable(skewTableName, {{"A", PeterDB::TypeInt, 4}, {"B", PeterDB::TypeInt, 4}}), success)
+                                    << "Create table " << skewTableName << " should succeed.";
+        tableNames.emplace_back(skewTableName);
+
+        // Half the tuples share key 50, which no repartitioning can split; the rest have distinct keys from 200
+        unsigned numTuples = 60000;
+        for (unsigned i = 0; i < numTuples; i++) {
+            unsigned b = i % 2 ? 50 : 200 + i / 2;
+            memset(inBuffer, 0, 1);
+            memcpy((char *) inBuffer + 1, &i, sizeof(unsigned));
+            memcpy((char *) inBuffer + 5, &b, sizeof(unsigned));
+            ASSERT_EQ(rm.insertTuple(skewTableName, inBuffer, rid), success)
+                                        << "relationManager.insertTuple() should succeed.";
+        }
+
+        // right.B is j % 251 + 20: key 50 twice, keys 200 to 270 once
+        std::string rightTableName = "right";
+        createAndPopulateTable(rightTableName, {}, 300);
+
+        PeterDB::TableScan leftIn(rm, skewTableName);
+        PeterDB::TableScan rightIn(rm, rightTableName);
+        unsigned count = 0, leftB, rightB;
+        {
+            PeterDB::GHJoin ghJoin(&leftIn, &rightIn, {"skew.B", PeterDB::EQ_OP, true, "right.B"}, 2);
+            while (ghJoin.getNextTuple(outBuffer) != QE_EOF) {
+                memcpy(&leftB, (char *) outBuffer + 5, sizeof(unsigned));
+                memcpy(&rightB, (char *) outBuffer + 9, sizeof(unsigned));
+                ASSERT_EQ(leftB, rightB) << "The joined tuples should have the same key.";
+                count++;
+            }
+            // Two pairs of partition files at first, one more for every repartition
+            ASSERT_GT(glob(TEMP_FILE_PREFIX "ghjoin_").size(), 4) << "The oversized partitions should have been partitioned again.";
+            // A partition that was split again is destroyed, so each left tuple is on disk once
+            size_t partitionSize = 0;
+            for (const auto &fileName : glob(TEMP_FILE_PREFIX "ghjoin_left")) partitionSize += getFileSize(fileName);
+            ASSERT_LT(partitionSize, 2 * getFileSize(skewTableName)) << "Split partitions should have been destroyed.";
+        }
+        ASSERT_EQ(count, numTuples / 2 * 2 + 71) << "The number of returned tuple is not correct.";
+        ASSERT_EQ(glob(TEMP_FILE_PREFIX "ghjoin_").size(), 0) << "There should be no partition file left.";
+
+    }
+
+    TEST_F(QE_Test, smjoin_with_index_scan) {
+        // 1. SMJoin -- an IndexScan input already in key order, a TableScan input sorted by the join
+        // SELECT * FROM left, right WHERE left.B = right.B
+
+        inBuffer = malloc(bufSize);
+        outBuffer = malloc(bufSize);
+
+        std::string leftTableName = "left";
+        createAndPopulateTable(leftTableName, {"B"}, 100);
+
+        std::string rightTableName = "right";
+        createAndPopulateTable(rightTableName, {}, 100);
+
+        PeterDB::IndexScan leftIn(rm, leftTableName, "B");
+        PeterDB::TableScan rightIn(rm, rightTableName);
+        PeterDB::SMJoin smJoin(&leftIn, &rightIn, {"left.B", PeterDB::EQ_OP, true, "right.B"}, 4);
+
+        // Go over the data through iterator
+        std::vector<std::string> printed;
+        unsigned b, lastB = 0;
+        ASSERT_EQ(smJoin.getAttributes(attrs), success) << "SMJoin.getAttributes() should succeed.";
+        while (smJoin.getNextTuple(outBuffer) != QE_EOF) {
+            b = *(unsigned *) ((char *) outBuffer + 5);
+            ASSERT_GE(b, lastB) << "Tuples should come in join key order.";
+            lastB = b;
+            std::stringstream stream;
+            ASSERT_EQ(rm.printTuple(attrs, outBuffer, stream), success)
+                                        << "RelationManager.printTuple() should succeed.";
+            printed.emplace_back(stream.str());
+            memset(outBuffer, 0, bufSize);
+        }
+
+        std::vector<std::string> expected;
+        for (int i = 0; i < 100; i++) {
+            unsigned a = i % 203;
+            unsigned b1 = (i + 10) % 197;
+            float c1 = (float) (i % 167) + 50.5f;
+            for (int j = 0; j < 100; j++) {
+                unsigned b2 = j % 251 + 20;
+                float c2 = (float) (j % 261) + 25.5f;
+                unsigned d = j % 179;
+                if (b1 == b2) {
+                    expected.emplace_back(
+                            "left.A: " + std::to_string(a) + ", left.B: " + std::to_string(b1) + ", left.C: " +
+                            std::to_string(c1) + ", right.B: " + std::to_string(b2) + ", right.C: " +
+                            std::to_string(c2) + ", right.D: " + std::to_string(d));
+                }
+            }
+        }
+        sort(expected.begin(), expected.end());
+        sort(printed.begin(), printed.end());
+
+        ASSERT_EQ(expected.size(), printed.size()) << "The number of returned tuple is not correct.";
+
+        for (int i = 0; i < expected.size(); ++i) {
+            checkPrintRecord(expected[i], printed[i]);
+        }
+
+    }
+
+    TEST_F(QE_Test, smjoin_with_large_key_group) {
+        // 1. SMJoin -- the right tuples of one key take more than numPages pages
+        // SELECT * FROM left, skew WHERE left.B = skew.B
+
+        inBuffer = malloc(bufSize);
+        outBuffer = malloc(bufSize);
+
+        std::string leftTableName = "left";
+        createAndPopulateTable(leftTableName, {"B"}, 300);
+
+        std::string skewTableName = "skew";
+        ASSERT_EQ(rm.createTable(skewTableName, {{"A", PeterDB::TypeInt, 4}, {"B", PeterDB::TypeInt, 4}}), success)
+                                    << "Create table " << skewTableName << " should succeed.";
+        tableNames.emplace_back(skewTableName);
+
+        // 3000 tuples of key 50, the rest matching nothing
+        unsigned numTuples = 4000;
+        for (unsigned i = 0; i < numTuples; i++) {
+            unsigned b = i < 3000 ? 50 : 1000 + i;
+            memset(inBuffer, 0, 1);
+            memcpy((char *) inBuffer + 1, &i, sizeof(unsigned));
+            memcpy((char *) inBuffer + 5, &b, sizeof(unsigned));
+            ASSERT_EQ(rm.insertTuple(skewTableName, inBuffer, rid), success)
+                                        << "relationManager.insertTuple() should succeed.";
+        }
+
+        // left.B is (i + 10) % 197, so key 50 comes from left tuples 40 and 237
+        PeterDB::IndexScan leftIn(rm, leftTableName, "B");
+        PeterDB::TableScan rightIn(rm, skewTableName);
+        unsigned count = 0, leftB, rightA, rightB, rightASum = 0;
+        {
+            PeterDB::SMJoin smJoin(&leftIn, &rightIn, {"left.B", PeterDB::EQ_OP, true, "skew.B"}, 2);
+            while (smJoin.getNextTuple(outBuffer) != QE_EOF) {
+                memcpy(&leftB, (char *) outBuffer + 5, sizeof(unsigned));
+                memcpy(&rightA, (char *) outBuffer + 13, sizeof(unsigned));
+                memcpy(&rightB, (char *) outBuffer + 17, sizeof(unsigned));
+                ASSERT_EQ(leftB, rightB) << "The joined tuples should have the same key.";
+                rightASum += rightA;
+                count++;
+            }
+        }
+        ASSERT_EQ(count, 2 * 3000) << "The number of returned tuple is not correct.";
+        ASSERT_EQ(rightASum, 2 * (2999 * 3000 / 2)) << "Every tuple of the group should join each left tuple once.";
+        ASSERT_EQ(glob(TEMP_FILE_PREFIX "smjoin_").size(), 0) << "There should be no group file left.";
+
+    }
+
+    TEST_F(QE_Test, sort_multi_pass_descending_and_top_k) {
+        // 1. Sort -- runs merged over several passes, a descending key before an ascending one
+        // 2. Sort -- only the first tuples, picked in memory and through the merge
+        // SELECT * FROM left ORDER BY C DESC, A ASC [LIMIT k]
+
+        inBuffer = malloc(bufSize);
+        outBuffer = malloc(bufSize);
+
+        std::string tableName = "left";
+        unsigned numTuples = 10000;
+        createAndPopulateTable(tableName, {}, numTuples);
+
+        // (C, A) of every tuple in the expected order, no two tuples tie on both
+        std::vector<std::pair<float, unsigned>> expected;
+        for (unsigned i = 0; i < numTuples; i++) {
+            expected.emplace_back((float) (i % 167) + 50.5f, i % 203);
+        }
+        std::sort(expected.begin(), expected.end(), [](const std::pair<float, unsigned> &tuple,
+                                                       const std::pair<float, unsigned> &other) {
+            return tuple.first > other.first || (tuple.first == other.first && tuple.second < other.second);
+        });
+        std::vector<PeterDB::SortKey> keys{{"left.C", false}, {"left.A", true}};
+
+        for (unsigned limit : {0u, 10u, 2000u}) {
+            PeterDB::TableScan input(rm, tableName);
+            std::vector<std::pair<float, unsigned>> sorted;
+            {
+                // Three pages make runs of a few hundred tuples merged two at a time
+                PeterDB::Sort sort(&input, keys, limit == 10 ? 4 : 3, limit);
+                if (limit != 10) EXPECT_GT(glob(TEMP_FILE_PREFIX "sort_").size(), 0) << "Runs should have been spilled.";
+                while (sort.getNextTuple(outBuffer) != QE_EOF) {
+                    sorted.emplace_back(*(float *) ((char *) outBuffer + 9), *(unsigned *) ((char *) outBuffer + 1));
+                }
+            }
+            ASSERT_EQ(glob(TEMP_FILE_PREFIX "sort_").size(), 0) << "There should be no run file left.";
+
+            unsigned count = limit == 0 ? numTuples : limit;
+            ASSERT_EQ(sorted.size(), count) << "The number of returned tuple is not correct.";
+            for (unsigned i = 0; i < count; i++) {
+                ASSERT_EQ(sorted[i], expected[i]) << "Tuples should come in sort key order.";
+            }
+        }
+
+    }
+
 } // namespace PeterDBTesting
\ No newline at end of file
@@ -328,6 +328,59 @@ namespace PeterDBTesting {
         ASSERT_EQ(memcmp(inBuffer, outBuffer, recordSize), 0) << "The returned record should match the inserted.";
     }
 
+    TEST_F(RBFM_Test, reuse_free_space_after_deletes) {
+        // Functions tested
+        // 1. Insert Record
+        // 2. Delete Record
+        // 3. Insert Record into the freed space
+        // 4. Read Record
+
+        PeterDB::RID rid;
+        size_t recordSize = 0;
+        inBuffer = malloc(100);
+        outBuffer = malloc(100);
+
+        std::vector<PeterDB::Attribute> recordDescriptor;
+        createRecordDescriptor(recordDescriptor);
+        nullsIndicator = initializeNullFieldsIndicator(recordDescriptor);
+
+        std::string name = "Free Space Reuse Test Employee";
+        unsigned numRecords = 2000;
+        std::vector<PeterDB::RID> rids;
+        for (unsigned i = 0; i < numRecords; i++) {
+            prepareRecord((int) recordDescriptor.size(), nullsIndicator, name.length(), name, i, 177.8, 6200,
+                          inBuffer, recordSize);
+            ASSERT_EQ(rbfm.insertRecord(fileHandle, recordDescriptor, inBuffer, rid), success)
+                                        << "Inserting a record should succeed.";
+            rids.push_back(rid);
+        }
+        unsigned numberOfPages = fileHandle.getNumberOfPages();
+        ASSERT_GT(numberOfPages, 4) << "The records should take several pages.";
+
+        // Empty the first half of the pages
+        unsigned deleted = 0;
+        for (const auto &deletedRid : rids) {
+            if (deletedRid.pageNum >= numberOfPages / 2) continue;
+            ASSERT_EQ(rbfm.deleteRecord(fileHandle, recordDescriptor, deletedRid), success)
+                                        << "Deleting a record should succeed.";
+            deleted++;
+        }
+
+        // As many records fit again without growing the file
+        for (unsigned i = 0; i < deleted; i++) {
+            prepareRecord((int) recordDescriptor.size(), nullsIndicator, name.length(), name, numRecords + i, 177.8,
+                          6200, inBuffer, recordSize);
+            ASSERT_EQ(rbfm.insertRecord(fileHandle, recordDescriptor, inBuffer, rid), success)
+                                        << "Inserting a record should succeed.";
+            ASSERT_LT(rid.pageNum, numberOfPages / 2) << "The record should go into a page emptied by deletes.";
+
+            ASSERT_EQ(rbfm.readRecord(fileHandle, recordDescriptor, rid, outBuffer), success)
+                                        << "Reading a record should succeed.";
+            ASSERT_EQ(memcmp(inBuffer, outBuffer, recordSize), 0) << "The returned record should match the inserted.";
+        }
+        ASSERT_EQ(fileHandle.getNumberOfPages(), numberOfPages) << "Reusing freed space should not add pages.";
+    }
+
     TEST_F(RBFM_Test, update_records) {
         // Functions tested
         // 1. Create Record-Based File
@@ -120,6 +120,63 @@ namespace PeterDBTesting {
         ASSERT_EQ(memcmp(inBuffer, outBuffer, tupleSize), 0) << "The returned tuple is not the same as the inserted.";
     }
 
+    TEST_F(RM_Tuple_Test, insert_tuples_in_batch) {
+        // Functions tested
+        // 1. Insert Tuples
+        // 2. Read Tuple
+        // 3. Index Scan over the batch
+
+        size_t tupleSize = 0;
+        unsigned numTuples = 500;
+        outBuffer = malloc(200);
+
+        ASSERT_EQ(rm.getAttributes(tableName, attrs), success) << "RelationManager::getAttributes() should succeed.";
+        nullsIndicator = initializeNullFieldsIndicator(attrs);
+        ASSERT_EQ(rm.createIndex(tableName, "age"), success) << "RelationManager::createIndex() should succeed.";
+
+        // Ages descending, so the index gets them out of insertion order
+        std::string name = "Peter Anteater";
+        std::vector<void *> tuples;
+        std::vector<const void *> batch;
+        std::vector<size_t> sizes;
+        for (unsigned i = 0; i < numTuples; i++) {
+            tuples.push_back(malloc(200));
+            prepareTuple((int) attrs.size(), nullsIndicator, name.length(), name, numTuples - i, 169.2, 9999.99,
+                         tuples[i], tupleSize);
+            batch.push_back(tuples[i]);
+            sizes.push_back(tupleSize);
+        }
+
+        std::vector<PeterDB::RID> rids;
+        ASSERT_EQ(rm.insertTuples(tableName, batch, rids), success) << "RelationManager::insertTuples() should succeed.";
+        ASSERT_EQ(rids.size(), numTuples) << "Every tuple should get a rid.";
+
+        for (unsigned i = 0; i < numTuples; i++) {
+            ASSERT_EQ(rm.readTuple(tableName, rids[i], outBuffer), success)
+                                        << "RelationManager::readTuple() should succeed.";
+            ASSERT_EQ(memcmp(tuples[i], outBuffer, sizes[i]), 0) << "The returned tuple is not the same as the inserted.";
+        }
+
+        // Every tuple is indexed with its rid
+        PeterDB::RM_IndexScanIterator rmisi;
+        ASSERT_EQ(rm.indexScan(tableName, "age", NULL, NULL, true, true, rmisi), success)
+                                    << "RelationManager::indexScan() should succeed.";
+        unsigned key, count = 0;
+        while (rmisi.getNextEntry(rid, &key) != RM_EOF) {
+            count++;
+            ASSERT_EQ(key, count) << "The index should return the keys in order.";
+            ASSERT_EQ(rid.pageNum, rids[numTuples - key].pageNum) << "The index should hold the tuple's rid.";
+            ASSERT_EQ(rid.slotNum, rids[numTuples - key].slotNum) << "The index should hold the tuple's rid.";
+        }
+        ASSERT_EQ(count, numTuples) << "Every tuple should be indexed.";
+        ASSERT_EQ(rmisi.close(), success) << "RM_IndexScanIterator should be able to close.";
+
+        ASSERT_NE(rm.insertTuples("non_existence_table", batch, rids), success)
+                                    << "Inserting into a non-existence table should not succeed.";
+
+        for (auto tuple : tuples) free(tuple);
+    }
+
     TEST_F(RM_Tuple_Test, insert_and_delete_and_read_tuple) {
         // Functions Tested
         // 1. Insert tuple
@@ -801,6 +858,138 @@ namespace PeterDBTesting {
 
     }
 
+    TEST_F(RM_Scan_Test, scan_with_multiple_conditions) {
+        // Functions Tested:
+        // 1. Scan with a conjunction of conditions
+        // 2. Scan with a disjunction of conjunctions
+
+        bufSize = 100;
+        size_t tupleSize = 0;
+        unsigned numTuples = 1500;
+        inBuffer = malloc(bufSize);
+        outBuffer = malloc(bufSize);
+
+        ASSERT_EQ(rm.getAttributes(tableName, attrs), success) << "RelationManager::getAttributes() should succeed.";
+        nullsIndicator = initializeNullFieldsIndicator(attrs);
+
+        for (unsigned i = 0; i < numTuples; i++) {
+            memset(inBuffer, 0, bufSize);
+            prepareTuple((int) attrs.size(), nullsIndicator, 6, "Tester", i % 50, (float) i, (float) (i % 7), inBuffer,
+                         tupleSize);
+            ASSERT_EQ(rm.insertTuple(tableName, inBuffer, rid), success)
+                                        << "RelationManager::insertTuple() should succeed.";
+        }
+
+        // age >= 10 AND age < 20 AND salary = 3
+        unsigned lowAge = 10, highAge = 20;
+        float salaryVal = 3;
+        std::vector<std::string> attributes{"age", "salary"};
+        ASSERT_EQ(rm.scan(tableName, {{"age", PeterDB::GE_OP, &lowAge}, {"age", PeterDB::LT_OP, &highAge},
+                                      {"salary", PeterDB::EQ_OP, &salaryVal}}, attributes, rmsi), success)
+                                    << "RelationManager::scan() should succeed.";
+        unsigned age, count = 0, expected = 0;
+        float salary;
+        for (unsigned i = 0; i < numTuples; i++) {
+            if (i % 50 >= lowAge && i % 50 < highAge && i % 7 == 3) expected++;
+        }
+        while (rmsi.getNextTuple(rid, outBuffer) != RM_EOF) {
+            age = *(unsigned *) ((uint8_t *) outBuffer + 1);
+            salary = *(float *) ((uint8_t *) outBuffer + 5);
+            ASSERT_TRUE(age >= lowAge && age < highAge && salary == salaryVal)
+                                        << "Returned value from a scan is not correct.";
+            count++;
+        }
+        ASSERT_EQ(count, expected) << "The scan should return every tuple satisfying all conditions.";
+        ASSERT_EQ(rmsi.close(), success) << "RM_ScanIterator should be able to close.";
+
+        // age = 5 OR (height >= 1400 AND salary != 0)
+        unsigned ageVal = 5;
+        float heightVal = 1400, zero = 0;
+        attributes = {"age", "height", "salary"};
+        ASSERT_EQ(rm.scan(tableName, {{{"age", PeterDB::EQ_OP, &ageVal}},
+                                      {{"height", PeterDB::GE_OP, &heightVal}, {"salary", PeterDB::NE_OP, &zero}}},
+                          attributes, rmsi), success) << "RelationManager::scan() should succeed.";
+        float height;
+        count = 0;
+        expected = 0;
+        for (unsigned i = 0; i < numTuples; i++) {
+            if (i % 50 == ageVal || (i >= heightVal && i % 7 != 0)) expected++;
+        }
+        while (rmsi.getNextTuple(rid, outBuffer) != RM_EOF) {
+            age = *(unsigned *) ((uint8_t *) outBuffer + 1);
+            height = *(float *) ((uint8_t *) outBuffer + 5);
+            salary = *(float *) ((uint8_t *) outBuffer + 9);
+            ASSERT_TRUE(age == ageVal || (height >= heightVal && salary != zero))
+                                        << "Returned value from a scan is not correct.";
+            count++;
+        }
+        ASSERT_EQ(count, expected) << "The scan should return every tuple satisfying any conjunction.";
+    }
+
+    TEST_F(RM_Scan_Test, parallel_scan) {
+        // Functions Tested:
+        // 1. Parallel scan of every tuple
+        // 2. Parallel scan with a condition
+
+        bufSize = 100;
+        size_t tupleSize = 0;
+        unsigned numTuples = 20000;     // several morsels for each worker
+        inBuffer = malloc(bufSize);
+        outBuffer = malloc(bufSize);
+
+        ASSERT_EQ(rm.getAttributes(tableName, attrs), success) << "RelationManager::getAttributes() should succeed.";
+        nullsIndicator = initializeNullFieldsIndicator(attrs);
+
+        std::vector<PeterDB::RID> rids;
+        for (unsigned i = 0; i < numTuples; i++) {
+            memset(inBuffer, 0, bufSize);
+            prepareTuple((int) attrs.size(), nullsIndicator, 6, "Tester", i % 50, (float) i, 123, inBuffer, tupleSize);
+            ASSERT_EQ(rm.insertTuple(tableName, inBuffer, rid), success)
+                                        << "RelationManager::insertTuple() should succeed.";
+            rids.push_back(rid);
+        }
+
+        // Every tuple is returned exactly once, with its own rid
+        std::vector<std::string> attributes{"age", "height"};
+        std::vector<bool> seen(numTuples, false);
+        unsigned age, count = 0;
+        float height;
+        {
+            PeterDB::RM_ParallelScanIterator rmpsi;
+            ASSERT_EQ(rm.parallelScan(tableName, {}, attributes, 4, rmpsi), success)
+                                        << "RelationManager::parallelScan() should succeed.";
+            while (rmpsi.getNextTuple(rid, outBuffer) != RM_EOF) {
+                height = *(float *) ((uint8_t *) outBuffer + 5);
+                auto i = (unsigned) height;
+                ASSERT_LT(i, numTuples) << "Returned value from a scan is not correct.";
+                ASSERT_FALSE(seen[i]) << "A tuple should be returned once.";
+                ASSERT_EQ(*(unsigned *) ((uint8_t *) outBuffer + 1), i % 50) << "Returned value from a scan is not correct.";
+                ASSERT_TRUE(rid.pageNum == rids[i].pageNum && rid.slotNum == rids[i].slotNum)
+                                            << "Returned rid from a scan is not correct.";
+                seen[i] = true;
+                count++;
+            }
+            ASSERT_EQ(rmpsi.close(), success) << "RM_ParallelScanIterator should be able to close.";
+        }
+        ASSERT_EQ(count, numTuples) << "The scan should return every tuple.";
+
+        // age < 10
+        unsigned ageVal = 10;
+        count = 0;
+        {
+            PeterDB::RM_ParallelScanIterator rmpsi;
+            ASSERT_EQ(rm.parallelScan(tableName, {{{"age", PeterDB::LT_OP, &ageVal}}}, attributes, 3, rmpsi), success)
+                                        << "RelationManager::parallelScan() should succeed.";
+            while (rmpsi.getNextTuple(rid, outBuffer) != RM_EOF) {
+                age = *(unsigned *) ((uint8_t *) outBuffer + 1);
+                ASSERT_LT(age, ageVal) << "Returned value from a scan is not correct.";
+                count++;
+            }
+            ASSERT_EQ(rmpsi.close(), success) << "RM_ParallelScanIterator should be able to close.";
+        }
+        ASSERT_EQ(count, numTuples / 5) << "The scan should return every tuple satisfying the condition.";
+    }
+
     TEST_F(RM_Catalog_Scan_Test, catalog_tables_table_check) {
         // Functions Tested:
         // 1. System Catalog Implementation - Tables table
@@ -1729,4 +1918,66 @@ namespace PeterDBTesting {
     }
 
 
+    TEST_F(RM_Tuple_Test, compact_index_after_deletes) {
+        // Functions tested
+        // 1. Create Index
+        // 2. Delete Tuple
+        // 3. Compact Index
+        // 4. Index Scan
+
+        size_t tupleSize = 0;
+        inBuffer = malloc(200);
+        outBuffer = malloc(200);
+
+        ASSERT_EQ(rm.getAttributes(tableName, attrs), success) << "RelationManager::getAttributes() should succeed.";
+        nullsIndicator = initializeNullFieldsIndicator(attrs);
+
+        std::string name = "Peter Anteater";
+        unsigned numTuples = 3000;
+        std::vector<PeterDB::RID> rids;
+        for (unsigned i = 0; i < numTuples; i++) {
+            prepareTuple((int) attrs.size(), nullsIndicator, name.length(), name, i, 169.2, 9999.99, inBuffer,
+                         tupleSize);
+            ASSERT_EQ(rm.insertTuple(tableName, inBuffer, rid), success)
+                                        << "RelationManager::insertTuple() should succeed.";
+            rids.push_back(rid);
+        }
+
+        ASSERT_EQ(rm.createIndex(tableName, "age"), success) << "RelationManager::createIndex() should succeed.";
+
+        // Keep every fourth tuple
+        for (unsigned i = 0; i < numTuples; i++) {
+            if (i % 4 == 0) continue;
+            ASSERT_EQ(rm.deleteTuple(tableName, rids[i]), success)
+                                        << "RelationManager::deleteTuple() should succeed.";
+        }
+
+        std::string indexFileName = tableName + "_2.idx";
+        ASSERT_TRUE(fileExists(indexFileName)) << "Index file " << indexFileName << " should exist.";
+        std::streampos sizeBefore = getFileSize(indexFileName);
+
+        ASSERT_EQ(rm.compactIndex(tableName, "age"), success) << "RelationManager::compactIndex() should succeed.";
+        ASSERT_LT(getFileSize(indexFileName), sizeBefore) << "The compacted index file should be smaller.";
+
+        ASSERT_NE(rm.compactIndex(tableName, "height"), success)
+                                    << "Compacting a column without an index should fail.";
+        ASSERT_NE(rm.compactIndex(tableName, "no_such_column"), success)
+                                    << "Compacting a non-existing column should fail.";
+
+        // Every remaining tuple is still reachable through the index, in key order
+        PeterDB::RM_IndexScanIterator rmisi;
+        ASSERT_EQ(rm.indexScan(tableName, "age", NULL, NULL, true, true, rmisi), success)
+                                    << "RelationManager::indexScan() should succeed.";
+        unsigned key;
+        unsigned expected = 0;
+        while (rmisi.getNextEntry(rid, &key) != RM_EOF) {
+            ASSERT_EQ(key, expected) << "The index should return the remaining keys in order.";
+            ASSERT_EQ(rid.pageNum, rids[expected].pageNum) << "The index should keep the tuple's rid.";
+            ASSERT_EQ(rid.slotNum, rids[expected].slotNum) << "The index should keep the tuple's rid.";
+            expected += 4;
+        }
+        ASSERT_EQ(expected, numTuples) << "Every remaining tuple should be found through the index.";
+        ASSERT_EQ(rmisi.close(), success) << "RM_IndexScanIterator should be able to close.";
+    }
+
 } // namespace PeterDBTesting
\ No newline at end of file